@@ -21,24 +21,57 @@
 
 #include "Arduino.h"
 #include "Wire.h"
+#include "azo_ki_hal.hpp"
+#include "azo_ki_ring.hpp"
+#include <type_traits>
 
 // Serial
 #define SERIAL_HEADER_A             0xCC
 #define SERIAL_HEADER_B             0xEF
 #define PACKET_LEN                  128
+#define SERIAL_RX_LEN               512     // Power of 2
+#define SERIAL_FRAME_MAX            (PACKET_LEN+7)
+#define SERIAL_RX_TIMEOUT           50      // ms
+#define SERIAL_TX_LEN               1024
+#define SERIAL_CMD_RING_LEN         1024    // Power of 2, received packets queued for the engine core (AZO_KI_DUAL_CORE)
+#define SERIAL_OUT_RING_LEN         4096    // Power of 2, response bytes queued for the serial core (AZO_KI_DUAL_CORE)
+#define STREAM_HEADER_LEN           10      // Stream ID, command, sequence, timestamp, fragment, status
+#define STREAM_DATA_LEN             (PACKET_LEN - STREAM_HEADER_LEN)
+#define STREAM_FRAGMENT_LAST        0x80
 #define MAX_STREAM                  20
-#define SCAN_DELAY                  20
+#define SCAN_DELAY                  20      // us, default and upper limit of the per phase scan delays
+#define SCAN_DELAY_PHASES           4
+#define SCAN_DELAY_MARGIN           2       // us, added to the measured settle time
+#define SCAN_CALIBRATE_REPEATS      8
+#define CONFIG_ACK_TIMEOUT          1000    // us, configuration handshake acknowledge timeout
+#define I2C_QUEUE_LEN               20
+#define I2C_TIMEOUT                 5       // ms, upper limit of a single I2C transfer
+#define I2C_RECOVER_PULSES          9       // SCL pulses to release a device holding SDA LOW
+#define I2C_RECOVER_DELAY           5       // us, SCL half period during bus recovery
+#define MAX_COLUMNS                 8       // Columns in the largest device matrix
+#define MAX_ROWS                    8       // Rows in the largest device matrix
+#define MAX_DEVICES                 (MAX_COLUMNS*MAX_ROWS)  // At most 64, key scan bitplanes hold one bit per device
+#define MATRIX_ARENA_LEN            1024    // bytes, per device tables and key scan bitplanes sized by the device setup
+#define REGISTER_CACHE_ENTRIES      (2*MAX_DEVICES)  // Shadowed register ranges of all devices
+#define REGISTER_CACHE_LEN          2048    // bytes, shadowed register data of all devices
+#define REGISTER_CACHE_STATIC       8       // Static register ranges served from the cache
+#define REGISTER_CACHE_SKIP         8       // Register ranges whose repeated writes are skipped
+#define STREAM_BURST_GAP            4       // bytes, largest gap between stream registers merged into one burst read
+#define IQS7X20A_REGISTER_BYTES     2       // bytes per register address
+#define IQS9320_REGISTER_BYTES      1       // bytes per register address
 #define AZQ700_KS_OUTPUT_PARAMS     5
 #define AZQ701_KS_OUTPUT_PARAMS     22
+#define IQS9320_MAX_CHANNELS        (AZQ701_KS_OUTPUT_PARAMS - 2)   // Channels of an IQS9320 key scan, 2 status planes precede them
 
-// GPIO hardware control registers
-extern uint32_t* gpio_input;
-extern uint32_t* gpio_output;
-extern uint32_t* gpio_output_set;
-extern uint32_t* gpio_output_clear;
-extern uint32_t* gpio_output_enable;
-extern uint32_t* gpio_output_enable_set;
-extern uint32_t* gpio_output_enable_clear;
+// CRC16 engine selection
+#define CRC_ENGINE_BITWISE          0
+#define CRC_ENGINE_TABLE            1
+#define CRC_ENGINE_SLICE4           2
+#define CRC_ENGINE_DMA              3
+#ifndef CRC_ENGINE
+#define CRC_ENGINE                  CRC_ENGINE_TABLE
+#endif
+#define CRC_DMA_MIN_LEN             32
 
 namespace AZO_KEYBOARD_INTERFACE
 {
@@ -48,6 +81,19 @@ namespace AZO_KEYBOARD_INTERFACE
         cmd_setup                               = 0x00,
         cmd_stop_streaming                      = 0x01,
         cmd_stop_comms                          = 0x02,
+        cmd_stream_ks_mode                      = 0x03,
+        cmd_stream_interval                     = 0x04,
+        cmd_stream_stats                        = 0x05,
+        cmd_scan_mode                           = 0x06,
+        cmd_scan_delay_read                     = 0x07,
+        cmd_scan_delay_write                    = 0x08,
+        cmd_scan_delay_calibrate                = 0x09,
+        cmd_config_status                       = 0x0A,
+        cmd_device_errors                       = 0x0B,
+        cmd_register_cache_stats                = 0x0C,
+        cmd_register_cache_invalidate           = 0x0D,
+        cmd_register_cache_static               = 0x0E,
+        cmd_register_cache_skip                 = 0x0F,
 
         // IQS7220A Commands
         cmd_iqs7220a_block_ks                   = 0x10,
@@ -97,16 +143,16 @@ namespace AZO_KEYBOARD_INTERFACE
         uint32_t i2c_clk;
         uint8_t pin_sda_0;
         uint8_t pin_scl_0;
-        uint32_t *c0_msk;
-        uint32_t *r0_msk;
-        uint32_t *r1_msk;
-        uint32_t *r2_msk;
-        uint32_t *r3_msk;
-        uint32_t *s0_msk;
-        uint32_t *s1_msk;
-        uint32_t *d0_msk;
-        uint32_t *d1_msk;
-        uint32_t c0_all;
+        uint32_t c0_msk[MAX_COLUMNS];   // Single bit per line, unused lines 0
+        uint32_t r0_msk[MAX_ROWS];
+        uint32_t r1_msk[MAX_ROWS];
+        uint32_t r2_msk[MAX_ROWS];
+        uint32_t r3_msk[MAX_ROWS];
+        uint32_t s0_msk[MAX_COLUMNS];
+        uint32_t s1_msk[MAX_COLUMNS];
+        uint32_t d0_msk[MAX_ROWS];
+        uint32_t d1_msk[MAX_ROWS];
+        uint32_t c0_all;                // Lines of the device matrix, selected by the gpio setup
         uint32_t r0_all;
         uint32_t r1_all;
         uint32_t r2_all;
@@ -115,6 +161,30 @@ namespace AZO_KEYBOARD_INTERFACE
         uint32_t s1_all;
         uint32_t d0_all;
         uint32_t d1_all;
+
+        // Derived from the masks by pin_settings_make()
+        uint8_t c0_shift[MAX_COLUMNS];  // Pin number of each column
+        uint8_t s0_shift[MAX_COLUMNS];
+        uint8_t s1_shift[MAX_COLUMNS];
+        uint8_t r0_shift[MAX_ROWS];     // Pin number of each row
+        uint8_t r1_shift[MAX_ROWS];
+        uint8_t r2_shift[MAX_ROWS];
+        uint8_t r3_shift[MAX_ROWS];
+        uint8_t d0_shift[MAX_ROWS];
+        uint8_t d1_shift[MAX_ROWS];
+        uint32_t c0_upto[MAX_COLUMNS + 1];  // Lines of the first n columns or rows
+        uint32_t s0_upto[MAX_COLUMNS + 1];
+        uint32_t s1_upto[MAX_COLUMNS + 1];
+        uint32_t r0_upto[MAX_ROWS + 1];
+        uint32_t r1_upto[MAX_ROWS + 1];
+        uint32_t r2_upto[MAX_ROWS + 1];
+        uint32_t r3_upto[MAX_ROWS + 1];
+        uint32_t d0_upto[MAX_ROWS + 1];
+        uint32_t d1_upto[MAX_ROWS + 1];
+        uint8_t iqs7x20a_columns;       // Largest device matrix the pinout wires, per device family
+        uint8_t iqs7x20a_rows;
+        uint8_t iqs9320_columns;
+        uint8_t iqs9320_rows;
     };
 
     struct stream_control_t
@@ -126,9 +196,74 @@ namespace AZO_KEYBOARD_INTERFACE
         uint8_t     num_registers;
         uint8_t     addr[20];
         uint8_t     len[20];
-        uint8_t     sample_interval;
-        uint32_t    timestamp;
+        uint8_t     num_bursts;         // Burst reads planned by stream_start(), 0 reads every register on its own
+        uint8_t     burst_addr[20];     // Same layout as addr
+        uint8_t     burst_len[20];
+        uint8_t     offset[20];         // Offset of every register in the burst data
+        uint32_t    sample_interval;    // us
+        uint64_t    deadline;           // hal_time_us() of the next sample
         uint8_t     num_channels; // for 701 KS only
+        uint8_t     command;
+        uint16_t    sequence;
+        uint8_t     keyframe_count;
+        uint32_t    samples;
+        uint32_t    missed;             // Deadlines that passed without a sample
+    };
+
+    struct scan_control_t
+    {
+        uint8_t     state;          // Family being scanned, scan_idle when no scan is in progress
+        uint8_t     column;
+        uint8_t     phase;
+        uint8_t     cycle;          // C0 cycle of the IQS9320
+        bool        c0_state;
+        uint32_t    c0_release;     // C0 of the previous column to set HIGH on the next edge (pipelined)
+        uint8_t     num_channels;   // for 701 KS only
+        uint8_t     delay_index;    // Scan delay phase of the last edge
+        uint64_t    deadline;       // hal_time_us() at which the lines have settled
+    };
+
+    struct i2c_transaction_t
+    {
+        uint8_t     device;         // Device index charged with errors of the read, 0xFF outside the device matrix
+        uint8_t     address;
+        uint8_t     reg[2];         // Register address, LSB first
+        uint8_t     reg_len;
+        uint8_t     *data;
+        uint8_t     len;
+    };
+
+    struct device_errors_t
+    {
+        uint16_t    nack;           // I2C transfers not acknowledged
+        uint16_t    bus_timeout;    // I2C transfers that timed out, each followed by a bus recovery
+        uint16_t    config_timeout; // Configuration handshake timeouts
+    };
+
+    struct register_cache_entry_t
+    {
+        uint8_t     device;         // Device index, column*num_rows + row
+        uint8_t     len;
+        uint16_t    addr;           // Byte address in the device register space
+        uint16_t    offset;         // Offset of the data in register_cache_t.data
+    };
+
+    struct register_cache_t
+    {
+        register_cache_entry_t  entry[REGISTER_CACHE_ENTRIES];
+        uint8_t                 num_entries;
+        uint8_t                 data[REGISTER_CACHE_LEN];
+        uint16_t                data_len;
+        uint16_t                static_addr[REGISTER_CACHE_STATIC];     // Register address
+        uint8_t                 static_len[REGISTER_CACHE_STATIC];      // bytes
+        uint8_t                 num_static;
+        uint16_t                skip_addr[REGISTER_CACHE_SKIP];         // Register address
+        uint8_t                 skip_len[REGISTER_CACHE_SKIP];          // bytes
+        uint8_t                 num_skip;
+        uint32_t                write_hits;
+        uint32_t                write_misses;
+        uint32_t                read_hits;
+        uint32_t                read_misses;
     };
 
     struct i2c_control_t
@@ -165,29 +300,259 @@ namespace AZO_KEYBOARD_INTERFACE
 
     };
 
-    extern pin_settings_t default_pin_settings;
-    extern uint8_t serial_data_byte;
+    enum stream_ks_modes_e
+    {
+        stream_ks_full          = 0x00,
+        stream_ks_delta         = 0x01
+    };
+
+    enum stream_ks_samples_e
+    {
+        ks_sample_keyframe      = 0x00,
+        ks_sample_delta         = 0x01
+    };
+
+    enum scan_states_e
+    {
+        scan_idle               = 0x00,
+        scan_iqs7220a           = 0x01,
+        scan_iqs7320a           = 0x02,
+        scan_iqs9320            = 0x03
+    };
+
+    enum scan_modes_e
+    {
+        scan_sequential         = 0x00,
+        scan_pipelined          = 0x01
+    };
+
+    enum config_status_e
+    {
+        config_ok               = 0x00,
+        config_ack_timeout      = 0x01,     // Device did not acknowledge the configuration state
+        config_release_timeout  = 0x02,     // Device did not release the acknowledge on exit
+        config_i2c_nack         = 0x04,     // Device did not acknowledge an I2C transfer
+        config_i2c_timeout      = 0x08      // I2C transfer timed out, the bus was recovered
+    };
+
+    enum serial_rx_states_e
+    {
+        rx_await_header_a       = 0x00,
+        rx_await_header_b       = 0x01,
+        rx_await_length         = 0x02,
+        rx_await_frame          = 0x03
+    };
+
+    /**
+    * @name   pin_number
+    * @brief  GPIO pin number of a single bit pin mask, 0 for an unused line.
+    */
+    constexpr uint8_t pin_number(uint32_t mask)
+    {
+        uint8_t pin = 0;
+
+        while (mask > 1)
+        {
+            mask >>= 1;
+            pin++;
+        }
+        return pin;
+    }
+
+    /**
+    * @name   pin_lines_make
+    * @brief  Pin numbers and the OR of the first n masks of one line of the pinout.
+    */
+    constexpr void pin_lines_make(const uint32_t msk[], uint8_t shift[], uint32_t upto[], uint8_t num_lines)
+    {
+        upto[0] = 0;
+        for (uint8_t i = 0; i < num_lines; i++)
+        {
+            shift[i] = pin_number(msk[i]);
+            upto[i + 1] = upto[i] | msk[i];
+        }
+    }
+
+    /**
+    * @name   pin_lines_count
+    * @brief  Number of lines of the pinout wired for every one of the given lines,
+    *         counting up to the first unused (0) mask.
+    */
+    constexpr uint8_t pin_lines_count(const uint32_t *const msk[], uint8_t num_msk, uint8_t num_lines)
+    {
+        for (uint8_t i = 0; i < num_lines; i++)
+        {
+            for (uint8_t j = 0; j < num_msk; j++)
+            {
+                if (msk[j][i] == 0) return i;
+            }
+        }
+        return num_lines;
+    }
+
+    /**
+    * @name   pin_settings_make
+    * @brief  Complete a pinout with the tables derived from its masks, so that the
+    *         gpio setup and the key scans do not compute them. A pinout known at compile
+    *         time, like default_pin_settings, is completed by the compiler.
+    * @param  pins -> Pinout with the serial, I2C and mask fields set
+    * @retval Returns the completed pinout.
+    */
+    constexpr pin_settings_t pin_settings_make(pin_settings_t pins)
+    {
+        pin_lines_make(pins.c0_msk, pins.c0_shift, pins.c0_upto, MAX_COLUMNS);
+        pin_lines_make(pins.s0_msk, pins.s0_shift, pins.s0_upto, MAX_COLUMNS);
+        pin_lines_make(pins.s1_msk, pins.s1_shift, pins.s1_upto, MAX_COLUMNS);
+        pin_lines_make(pins.r0_msk, pins.r0_shift, pins.r0_upto, MAX_ROWS);
+        pin_lines_make(pins.r1_msk, pins.r1_shift, pins.r1_upto, MAX_ROWS);
+        pin_lines_make(pins.r2_msk, pins.r2_shift, pins.r2_upto, MAX_ROWS);
+        pin_lines_make(pins.r3_msk, pins.r3_shift, pins.r3_upto, MAX_ROWS);
+        pin_lines_make(pins.d0_msk, pins.d0_shift, pins.d0_upto, MAX_ROWS);
+        pin_lines_make(pins.d1_msk, pins.d1_shift, pins.d1_upto, MAX_ROWS);
+
+        const uint32_t *const iqs7x20a_columns[] = {pins.s0_msk, pins.s1_msk};
+        const uint32_t *const iqs7x20a_rows[] = {pins.d0_msk, pins.d1_msk};
+        const uint32_t *const iqs9320_columns[] = {pins.c0_msk};
+        const uint32_t *const iqs9320_rows[] = {pins.r0_msk, pins.r1_msk, pins.r2_msk, pins.r3_msk};
+        pins.iqs7x20a_columns = pin_lines_count(iqs7x20a_columns, 2, MAX_COLUMNS);
+        pins.iqs7x20a_rows = pin_lines_count(iqs7x20a_rows, 2, MAX_ROWS);
+        pins.iqs9320_columns = pin_lines_count(iqs9320_columns, 1, MAX_COLUMNS);
+        pins.iqs9320_rows = pin_lines_count(iqs9320_rows, 4, MAX_ROWS);
+        return pins;
+    }
+
+    extern const pin_settings_t default_pin_settings;
+
+    /**
+    * @name   rows_sample
+    * @brief  Gather the rows of one line from a single GPIO input read, bit n holds
+    *         row n. The row count is a template parameter, so the loop is unrolled.
+    * @param  input -> GPIO input register value
+    * @param  shift -> Pin number of each row
+    * @retval Returns the row bits.
+    */
+    template <uint8_t ROWS>
+    static inline uint32_t rows_sample(uint32_t input, const uint8_t shift[])
+    {
+        uint32_t rows = 0;
+
+#pragma GCC unroll 8
+        for (uint8_t i = 0; i < ROWS; i++)
+        {
+            rows |= ((input >> shift[i]) & 1) << i;
+        }
+        return rows;
+    }
+
+    /**
+    * @name   rows_dispatch
+    * @brief  Call fn with std::integral_constant<uint8_t, num_rows>. Every matrix
+    *         height from 1 to MAX_ROWS gets its own code, in which the row loops are
+    *         unrolled and the device index math is folded by the compiler.
+    * @param  num_rows -> Rows of the device matrix
+    * @param  fn -> Callable taking the row count as an integral constant
+    * @retval Returns the result of fn, or true if num_rows is out of range.
+    */
+    template <uint8_t ROWS = 1, typename F>
+    static inline bool rows_dispatch(uint8_t num_rows, F fn)
+    {
+        if constexpr (ROWS > MAX_ROWS)
+        {
+            return true;
+        }
+        else
+        {
+            if (num_rows == ROWS) return fn(std::integral_constant<uint8_t, ROWS>());
+            return rows_dispatch<ROWS + 1>(num_rows, fn);
+        }
+    }
+
+    // CRC16 (CCITT, initial value 0xFFFF) engines - azo_ki_crc.cpp
+    uint16_t crc16_bitwise(const uint8_t data[], size_t data_len);
+    uint16_t crc16_table(const uint8_t data[], size_t data_len);
+    uint16_t crc16_slice4(const uint8_t data[], size_t data_len);
+    uint16_t crc16_dma(const uint8_t data[], size_t data_len);
 
     class KeyboardInterface
     {
         private:
             pin_settings_t      pin_settings;
-            stream_control_t    stream_control;
+            stream_control_t    stream_control[MAX_STREAM];
+            uint8_t             stream_heap[MAX_STREAM];    // Active slots, min-heap ordered by deadline
+            uint8_t             stream_heap_len;
+            uint8_t             stream_slot;                // Slot being sampled
+            uint8_t             stream_ks_mode;
+            uint8_t             stream_keyframe_interval;   // Samples between key scan keyframes in delta mode
+            scan_control_t      scan_control;
+            uint8_t             scan_mode;
+            uint8_t             scan_delay[4][SCAN_DELAY_PHASES];   // us, per scan_states_e family and phase
+            uint8_t             config_status;      // config_status_e flags since the last status command
+            uint16_t            config_timeouts;    // Handshake timeouts since power up
+            uint8_t             config_column;      // Column placed in the configuration state (IQS7x20A)
+            device_errors_t     *device_errors;             // Per device index, from the matrix arena
+            device_errors_t     device_errors_outside;      // Counts devices outside the matrix
+            uint16_t            i2c_recoveries;     // Bus recoveries since power up
             i2c_control_t       i2c_control;
+            register_cache_t    register_cache;     // Shadow of the registers written to and static registers read from the devices
             bool                setup_complete;
             uint8_t             device;
             uint8_t             num_columns;
             uint8_t             num_rows;
+            uint8_t             *device_row;        // Row of each device index, from the matrix arena
+            uint8_t             *device_column;     // Column of each device index, from the matrix arena
+            alignas(8) uint8_t  matrix_arena[MATRIX_ARENA_LEN];  // Storage sized by the device setup for its matrix
+            uint16_t            matrix_arena_len;   // Bytes taken since the last device setup
             
 
             // Serial
-            uint8_t serial_packet_data[PACKET_LEN];
+            uint8_t *serial_packet_data;    // Packet being executed
+            uint8_t *serial_rx_packet;      // Last packet parsed, view into serial_rx_ring
+            uint8_t serial_rx_packet_len;
             uint8_t serial_output_data[PACKET_LEN+6];
-            uint8_t serial_input_data[PACKET_LEN+6];
-            uint8_t serial_input_index;
+            uint8_t serial_rx_ring[SERIAL_RX_LEN + SERIAL_FRAME_MAX];   // Start mirrored at the end
+            uint16_t serial_rx_head;
+            uint16_t serial_rx_tail;
+            uint16_t serial_rx_consumed;
+            uint8_t serial_rx_state;
+            uint32_t serial_rx_timestamp;
             uint8_t serial_output_index;
-            uint8_t serial_packet_index;
             uint8_t serial_packet_len;
+            bool serial_packet_pending;                     // Packet received during a key scan, not executed yet
+            uint8_t serial_tx_buffer[2][SERIAL_TX_LEN];     // One buffer is filled while the other is sent
+            uint16_t serial_tx_len[2];
+            uint16_t serial_tx_index;                       // Bytes of the sending buffer written to serial
+            uint8_t serial_tx_active;                       // Buffer being filled
+
+#if defined(AZO_KI_DUAL_CORE)
+            // Core 0 runs serial, core 1 the engine (commands, streams, key scans and I2C)
+            SpscRing<SERIAL_CMD_RING_LEN> command_ring;     // Length prefixed packets, core 0 to core 1
+            SpscRing<SERIAL_OUT_RING_LEN> output_ring;      // Response bytes, core 1 to core 0
+            uint8_t serial_command[PACKET_LEN];             // Packet taken from command_ring
+#endif
+
+            // Stream frame under construction, data starts after the frame and stream headers
+            uint8_t stream_frame[3 + STREAM_HEADER_LEN + STREAM_DATA_LEN + 4];
+            uint8_t stream_frame_len;
+            uint8_t stream_frame_fragment;
+            uint32_t stream_frame_timestamp;
+            bool stream_frame_active;
+            bool stream_frame_skip;
+            uint8_t stream_frame_status;    // config_status_e flags of the current sample
+
+            // Queued I2C reads, the first one is in progress when active
+            i2c_transaction_t i2c_queue[I2C_QUEUE_LEN];
+            uint8_t i2c_queue_head;
+            uint8_t i2c_queue_len;
+            bool i2c_queue_active;
+            uint64_t i2c_queue_deadline;    // hal_time_us() at which the read in progress times out
+            uint8_t i2c_device;             // Device index of the transfers, 0xFF outside the device matrix
+            bool i2c_write_failed;          // Register address write failed, the read that follows is skipped
+
+            // Key scan bitplanes of the device family, bit (column*num_rows + row) per channel,
+            // and of the previous stream sample for delta streaming. From the matrix arena.
+            uint64_t *key_scan_planes;
+            uint64_t *key_scan_previous;
+            uint8_t key_scan_num_planes;
 
         public:
             // Constructors
@@ -200,37 +565,110 @@ namespace AZO_KEYBOARD_INTERFACE
             void                device_setup(device_e platform, uint8_t num_columns, uint8_t num_rows);
             uint8_t             get_device_row(uint8_t device_select);
             uint8_t             get_device_column(uint8_t device_select);
+            void*               matrix_alloc(uint16_t len);
             void                do_comms();
+            void                do_engine();
+            bool                command_next();
             void                do_command();
+#if defined(AZO_KI_DUAL_CORE)
+            std::atomic<bool>   comms_ready;        // Set once comms_setup() has completed, core 1 waits for it
+#endif
+
+            // Stream
+            stream_control_t*   stream_select(uint8_t command);
+            void                stream_start(stream_control_t *stream);
+            void                stream_stop(uint8_t slot);
+            void                stream_stop_all();
+            uint8_t             stream_ks_others(uint8_t command);
+            void                stream_set_interval(uint8_t slot, uint32_t sample_interval);
+            bool                stream_schedule();
+            void                stream_sample(uint8_t slot);
+            void                stream_heap_push(uint8_t slot);
+            void                stream_heap_remove(uint8_t index);
+            void                stream_plan_bursts(stream_control_t *stream, uint8_t addr_bytes, uint8_t register_bytes);
+            bool                stream_registers_valid(uint8_t index, uint8_t addr_bytes);
+            void                stream_read_registers(const stream_control_t *stream, uint8_t addr_bytes);
+            void                stream_skip_registers(const stream_control_t *stream);
+
+            // Scan
+            void                scan_start(uint8_t state, uint8_t num_channels);
+            bool                scan_step();
+            void                scan_output();
+            void                scan_cancel();
+            uint8_t             scan_family();
+            bool                scan_calibrate(uint8_t num_channels);
+            void                settle_wait(uint64_t deadline);
+            bool                config_await(uint32_t mask, bool level, uint8_t status);
+
+            // I2C
+            bool                i2c_submit(const uint8_t reg[], uint8_t reg_len, uint8_t data[], uint8_t len);
+            bool                i2c_service();
+            void                i2c_wait();
+            void                i2c_read_blocking(const i2c_transaction_t *transaction);
+            void                i2c_begin();
+            bool                i2c_end(bool stop);
+            uint8_t             i2c_request(uint8_t address, uint8_t len);
+            void                i2c_error(uint8_t status, uint8_t device_index);
+            void                i2c_bus_recover();
+            device_errors_t*    i2c_device_errors(uint8_t device_index);
+
+            // Register cache
+            uint16_t            cache_byte_addr(uint16_t register_addr);
+            register_cache_entry_t* cache_find(uint8_t device_index, uint16_t addr, uint8_t len);
+            bool                cache_write_hit(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len);
+            bool                cache_read_hit(uint8_t device_index, uint16_t register_addr, uint8_t data[], uint8_t len);
+            void                cache_store(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len);
+            void                cache_store_read(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len);
+            void                cache_store_write(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len);
+            void                cache_drop(uint8_t device_index, uint16_t addr, uint8_t len);
+            void                cache_invalidate(uint8_t device_index);
+            bool                cache_in_ranges(uint16_t register_addr, uint8_t len, const uint16_t range_addr[], const uint8_t range_len[], uint8_t num_ranges);
+            bool                cache_static(uint16_t register_addr, uint8_t len);
+            bool                cache_skip(uint16_t register_addr, uint8_t len);
 
             // Serial
             bool                read_serial();
             bool                test_for_packet();
-            void                send_packet_response();
+            void                send_packet_response(const uint8_t packet[]);
+            void                write_serial();
+            void                serial_tx_append(const uint8_t data[], uint16_t data_len);
+            void                serial_tx_swap();
+            void                serial_tx_drain();
+            void                serial_service();
+            void                output_append(const uint8_t data[], uint16_t data_len);
+            void                output_flush();
+            void                output_write(uint8_t data);
+            void                output_write(const uint8_t data[], uint16_t data_len);
+            void                output_zeros(uint16_t data_len);
+            void                stream_frame_begin();
+            void                stream_frame_send(bool last);
+            void                stream_frame_end();
+            void                key_scan_output(const uint64_t planes[], uint8_t num_planes, uint8_t num_bytes);
             uint16_t            get_crc(uint8_t data[], uint8_t data_len);
 
 
             // IQS7220A
-            bool iqs7220a_key_scan_results[6][6][5];
             void iqs7220a_gpio_setup();
-            void iqs7220a_scan_keys_column(uint8_t column_select);
+            bool iqs7220a_scan_step();
+            template <uint8_t ROWS> bool iqs7220a_scan_rows();
             void iqs7220a_scan_keys_all();
             void iqs7220a_config_enter_column(uint8_t column_select);
-            void iqs7220a_config_enter_row(uint8_t row_select);
-            void iqs7220a_config_exit_row(uint8_t row_select);
+            bool iqs7220a_config_enter_row(uint8_t row_select);
+            bool iqs7220a_config_exit_row(uint8_t row_select);
             void iqs7220a_i2c_read_single();
             void iqs7220a_i2c_write_single();
             void iqs7220a_i2c_read_multi();
+            void iqs7220a_i2c_read_batch(const stream_control_t *stream);
             void iqs7220a_i2c_write_multi();
             
             // IQS7320A
-            bool iqs7320a_key_scan_results[6][6][5];
             void iqs7320a_gpio_setup();
-            void iqs7320a_scan_keys_column(uint8_t column_select);
+            bool iqs7320a_scan_step();
+            template <uint8_t ROWS> bool iqs7320a_scan_rows();
             void iqs7320a_scan_keys_all();
             void iqs7320a_config_enter_column(uint8_t column_select);
-            void iqs7320a_config_enter_row(uint8_t row_select);
-            void iqs7320a_config_exit_row(uint8_t row_select);
+            bool iqs7320a_config_enter_row(uint8_t row_select);
+            bool iqs7320a_config_exit_row(uint8_t row_select);
             void iqs7320a_autonomous_enter();
             void iqs7320a_autonomous_exit();
             void iqs7320a_standby_enter();
@@ -238,20 +676,22 @@ namespace AZO_KEYBOARD_INTERFACE
             void iqs7320a_i2c_read_single();
             void iqs7320a_i2c_write_single();
             void iqs7320a_i2c_read_multi();
+            void iqs7320a_i2c_read_batch(const stream_control_t *stream);
             void iqs7320a_i2c_write_multi();
 
             // IQS9320
-            bool iqs9320_key_scan_results[6][6][22];
             void iqs9320_gpio_setup();
-            void iqs9320_scan_keys_column(uint8_t column_select, uint8_t num_channels);
+            bool iqs9320_scan_step();
+            template <uint8_t ROWS> bool iqs9320_scan_rows();
             void iqs9320_scan_keys_all(uint8_t num_channels);
-            void iqs9320_config_enter(uint8_t column_select, uint8_t row_select);
-            void iqs9320_config_exit(uint8_t row_select);
+            bool iqs9320_config_enter(uint8_t column_select, uint8_t row_select);
+            bool iqs9320_config_exit(uint8_t row_select);
             void iqs9320_standby_enter();
             void iqs9320_standby_exit();
             void iqs9320_i2c_read_fp();
             void iqs9320_i2c_write_fp();
-            void iqs9320_i2c_read_ks();
-            void iqs9320_i2c_write_ks();
+            bool iqs9320_i2c_read_ks();
+            void iqs9320_i2c_read_ks_batch(const stream_control_t *stream);
+            bool iqs9320_i2c_write_ks();
     };
 }
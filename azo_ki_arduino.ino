@@ -31,4 +31,18 @@ void loop()
     // Respond to serial communications if any have been received
     // Sample and communicate data if streaming has been configured
     kb_obj.do_comms();
-}
\ No newline at end of file
+}
+
+#if defined(AZO_KI_DUAL_CORE)
+void setup1()
+{
+    // Wait for core 0 to set up serial and I2C
+    while (!kb_obj.comms_ready.load(std::memory_order_acquire));
+}
+
+void loop1()
+{
+    // Execute received commands, sample streams and key scan, core 0 sends the results
+    kb_obj.do_engine();
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,322 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_cache.cpp                                              *
+ * @brief       Shadow of the registers of the devices in the device matrix.  *
+ *              Writes to skip ranges of data the device already holds are    *
+ *              skipped, reads of static registers are answered without the   *
+ *              bus.                                                          *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include "azo_ki.hpp"
+
+namespace AZO_KEYBOARD_INTERFACE
+{
+    /**
+    * @name   cache_byte_addr
+    * @brief  Byte address of a register in the register space of the set up device.
+    *         IQS7x20A register addresses hold 2 bytes, IQS9320 addresses 1 byte.
+    * @param  register_addr -> Register address as sent over I2C
+    * @retval Returns the byte address.
+    */
+    uint16_t KeyboardInterface::cache_byte_addr(uint16_t register_addr)
+    {
+        if (this->device == dev_iqs9320_ks) return register_addr*IQS9320_REGISTER_BYTES;
+        return register_addr*IQS7X20A_REGISTER_BYTES;
+    }
+
+    /**
+    * @name   cache_find
+    * @brief  Find the shadowed range of a device which holds all the given bytes.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @param  addr -> Byte address of the first byte
+    * @param  len -> Number of bytes
+    * @retval Returns nullptr if no single range holds all the bytes.
+    */
+    register_cache_entry_t* KeyboardInterface::cache_find(uint8_t device_index, uint16_t addr, uint8_t len)
+    {
+        for (uint8_t i = 0; i < this->register_cache.num_entries; i++)
+        {
+            register_cache_entry_t *entry = &(this->register_cache.entry[i]);
+
+            if ((entry->device == device_index) && (entry->addr <= addr) &&
+                ((uint32_t)addr + len <= (uint32_t)entry->addr + entry->len))
+            {
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+    * @name   cache_write_hit
+    * @brief  Compare a register write with the shadow of the device. Only writes within
+    *         a skip range set by the Write Skip Range command are ever skipped, command
+    *         and status registers must always reach the device.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @param  register_addr -> Register address of the write
+    * @param  data -> Data to write
+    * @param  len -> Number of bytes to write
+    * @retval Returns true if the device already holds the data and the write can be skipped.
+    */
+    bool KeyboardInterface::cache_write_hit(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len)
+    {
+        uint16_t addr = this->cache_byte_addr(register_addr);
+        register_cache_entry_t *entry;
+
+        if (!this->cache_skip(register_addr, len)) return false;
+
+        entry = this->cache_find(device_index, addr, len);
+
+        if ((entry != nullptr) && (memcmp(&(this->register_cache.data[entry->offset + addr - entry->addr]), data, len) == 0))
+        {
+            this->register_cache.write_hits++;
+            return true;
+        }
+        this->register_cache.write_misses++;
+        return false;
+    }
+
+    /**
+    * @name   cache_read_hit
+    * @brief  Read static registers of a device from the cache. Reads outside the
+    *         static ranges are never served from the cache.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @param  register_addr -> Register address of the read
+    * @param  data -> Receives the register data on a hit
+    * @param  len -> Number of bytes to read
+    * @retval Returns false if the registers must be read from the device.
+    */
+    bool KeyboardInterface::cache_read_hit(uint8_t device_index, uint16_t register_addr, uint8_t data[], uint8_t len)
+    {
+        uint16_t addr = this->cache_byte_addr(register_addr);
+        register_cache_entry_t *entry;
+
+        if (!this->cache_static(register_addr, len)) return false;
+
+        entry = this->cache_find(device_index, addr, len);
+        if (entry == nullptr)
+        {
+            this->register_cache.read_misses++;
+            return false;
+        }
+
+        memcpy(data, &(this->register_cache.data[entry->offset + addr - entry->addr]), len);
+        this->register_cache.read_hits++;
+        return true;
+    }
+
+    /**
+    * @name   cache_store
+    * @brief  Shadow registers written to or read from a device. Shadowed ranges
+    *         of the device that overlap the new range are dropped. When the cache
+    *         is full it is cleared and starts over.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @param  register_addr -> Register address of the transfer
+    * @param  data -> Register data
+    * @param  len -> Number of bytes
+    * @retval None
+    */
+    void KeyboardInterface::cache_store(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len)
+    {
+        register_cache_t *cache = &(this->register_cache);
+        uint16_t addr = this->cache_byte_addr(register_addr);
+        register_cache_entry_t *entry;
+
+        if ((device_index >= MAX_DEVICES) || (len == 0)) return;
+
+        // Update in place when a single range holds all the bytes
+        entry = this->cache_find(device_index, addr, len);
+        if (entry != nullptr)
+        {
+            memcpy(&(cache->data[entry->offset + addr - entry->addr]), data, len);
+            return;
+        }
+
+        // Drop overlapping ranges, their data is no longer complete
+        this->cache_drop(device_index, addr, len);
+
+        if ((cache->num_entries >= REGISTER_CACHE_ENTRIES) || (cache->data_len + len > REGISTER_CACHE_LEN))
+        {
+            this->cache_invalidate(0xFF);
+        }
+
+        entry = &(cache->entry[cache->num_entries++]);
+        entry->device = device_index;
+        entry->addr = addr;
+        entry->len = len;
+        entry->offset = cache->data_len;
+        memcpy(&(cache->data[cache->data_len]), data, len);
+        cache->data_len += len;
+    }
+
+    /**
+    * @name   cache_store_read
+    * @brief  Compare the data of a complete read with the shadow of the device. A device
+    *         that changed shadowed registers on its own, for example after a reset or ATI,
+    *         has its whole shadow dropped. The data is shadowed if the registers are static.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @param  register_addr -> Register address of the read
+    * @param  data -> Register data
+    * @param  len -> Number of bytes
+    * @retval None
+    */
+    void KeyboardInterface::cache_store_read(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len)
+    {
+        register_cache_t *cache = &(this->register_cache);
+        uint16_t addr = this->cache_byte_addr(register_addr);
+
+        for (uint8_t i = 0; i < cache->num_entries; i++)
+        {
+            register_cache_entry_t *entry = &(cache->entry[i]);
+            uint16_t start, end;
+
+            if (entry->device != device_index) continue;
+
+            // Bytes of the read held by this range
+            start = (entry->addr > addr) ? entry->addr : addr;
+            end = (entry->addr + entry->len < addr + len) ? entry->addr + entry->len : addr + len;
+            if ((start < end) && (memcmp(&(cache->data[entry->offset + start - entry->addr]), &(data[start - addr]), end - start) != 0))
+            {
+                this->cache_invalidate(device_index);
+                break;
+            }
+        }
+
+        if (this->cache_static(register_addr, len)) this->cache_store(device_index, register_addr, data, len);
+    }
+
+    /**
+    * @name   cache_store_write
+    * @brief  Shadow the data of a completed write within a skip or static range. Any other
+    *         write drops the shadowed bytes it overlaps.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @param  register_addr -> Register address of the write
+    * @param  data -> Register data
+    * @param  len -> Number of bytes
+    * @retval None
+    */
+    void KeyboardInterface::cache_store_write(uint8_t device_index, uint16_t register_addr, const uint8_t data[], uint8_t len)
+    {
+        if (this->cache_skip(register_addr, len) || this->cache_static(register_addr, len))
+            this->cache_store(device_index, register_addr, data, len);
+        else
+            this->cache_drop(device_index, this->cache_byte_addr(register_addr), len);
+    }
+
+    /**
+    * @name   cache_drop
+    * @brief  Drop the shadowed ranges of a device which overlap the given bytes.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @param  addr -> Byte address of the first byte
+    * @param  len -> Number of bytes
+    * @retval None
+    */
+    void KeyboardInterface::cache_drop(uint8_t device_index, uint16_t addr, uint8_t len)
+    {
+        register_cache_t *cache = &(this->register_cache);
+
+        for (uint8_t i = 0; i < cache->num_entries; )
+        {
+            register_cache_entry_t *entry = &(cache->entry[i]);
+
+            if ((entry->device == device_index) && (entry->addr < addr + len) && (addr < entry->addr + entry->len))
+            {
+                *entry = cache->entry[--cache->num_entries];
+                continue;
+            }
+            i++;
+        }
+    }
+
+    /**
+    * @name   cache_invalidate
+    * @brief  Drop the shadowed registers of a device, the next write or static read
+    *         goes to the device.
+    * @param  device_index -> Device index, 0xFF drops the registers of all devices
+    * @retval None
+    */
+    void KeyboardInterface::cache_invalidate(uint8_t device_index)
+    {
+        register_cache_t *cache = &(this->register_cache);
+
+        if (device_index == 0xFF)
+        {
+            cache->num_entries = 0;
+            cache->data_len = 0;
+            return;
+        }
+
+        for (uint8_t i = 0; i < cache->num_entries; )
+        {
+            if (cache->entry[i].device == device_index)
+            {
+                cache->entry[i] = cache->entry[--cache->num_entries];
+                continue;
+            }
+            i++;
+        }
+    }
+
+    /**
+    * @name   cache_in_ranges
+    * @brief  Test whether registers lie in one of the given register ranges.
+    * @param  register_addr -> Register address of the transfer
+    * @param  len -> Number of bytes
+    * @param  range_addr -> Register address of each range
+    * @param  range_len -> Length of each range in bytes
+    * @param  num_ranges -> Number of ranges
+    * @retval Returns true if all bytes lie in a single range.
+    */
+    bool KeyboardInterface::cache_in_ranges(uint16_t register_addr, uint8_t len, const uint16_t range_addr[], const uint8_t range_len[], uint8_t num_ranges)
+    {
+        uint16_t addr = this->cache_byte_addr(register_addr);
+
+        for (uint8_t i = 0; i < num_ranges; i++)
+        {
+            uint16_t start = this->cache_byte_addr(range_addr[i]);
+
+            if ((start <= addr) && ((uint32_t)addr + len <= (uint32_t)start + range_len[i]))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+    * @name   cache_static
+    * @brief  Test whether registers lie in a static range set by the Static Register Range command.
+    * @param  register_addr -> Register address of the read
+    * @param  len -> Number of bytes
+    * @retval Returns true if all bytes are static.
+    */
+    bool KeyboardInterface::cache_static(uint16_t register_addr, uint8_t len)
+    {
+        return this->cache_in_ranges(register_addr, len, this->register_cache.static_addr,
+                                     this->register_cache.static_len, this->register_cache.num_static);
+    }
+
+    /**
+    * @name   cache_skip
+    * @brief  Test whether registers lie in a skip range set by the Write Skip Range command.
+    * @param  register_addr -> Register address of the write
+    * @param  len -> Number of bytes
+    * @retval Returns true if a repeated write of all bytes may be skipped.
+    */
+    bool KeyboardInterface::cache_skip(uint16_t register_addr, uint8_t len)
+    {
+        return this->cache_in_ranges(register_addr, len, this->register_cache.skip_addr,
+                                     this->register_cache.skip_len, this->register_cache.num_skip);
+    }
+}
\ No newline at end of file
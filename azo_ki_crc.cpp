@@ -0,0 +1,208 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_crc.cpp                                                *
+ * @brief       CRC16 (CCITT, polynomial 0x1021, initial value 0xFFFF)        *
+ *              engines for serial frames. Bit-by-bit, byte-wise table,       *
+ *              slicing-by-4 table and RP2040 DMA sniffer implementations.    *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include "azo_ki.hpp"
+
+#if defined(ARDUINO_ARCH_RP2040)
+#include "hardware/dma.h"
+#endif
+
+namespace AZO_KEYBOARD_INTERFACE
+{
+    struct crc16_tables_t
+    {
+        uint16_t table[4][256];
+    };
+
+    /**
+    * @name   crc16_make_tables
+    * @brief  Generates the slicing-by-4 lookup tables at compile time.
+    *         table[0] is the byte-wise table, table[n] advances table[n-1]
+    *         by another 8 zero bits.
+    * @param  None
+    * @retval Lookup tables
+    */
+    static constexpr crc16_tables_t crc16_make_tables()
+    {
+        crc16_tables_t tables = {};
+
+        for (uint16_t i = 0; i < 256; i++)
+        {
+            uint16_t crc = i << 8;
+            for (uint8_t j = 0; j < 8; j++)
+            {
+                crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+            }
+            tables.table[0][i] = crc;
+        }
+
+        for (uint8_t n = 1; n < 4; n++)
+        {
+            for (uint16_t i = 0; i < 256; i++)
+            {
+                uint16_t crc = tables.table[n-1][i];
+                tables.table[n][i] = (uint16_t)(crc << 8) ^ tables.table[0][crc >> 8];
+            }
+        }
+
+        return tables;
+    }
+
+    static constexpr crc16_tables_t crc16_tables = crc16_make_tables();
+
+    /**
+    * @name   crc16_bitwise
+    * @brief  Bit-by-bit CRC16, eight shift/XOR iterations per byte.
+    * @param  data -> Random byte array
+    * @param  data_len -> Length of data parameter
+    * @retval Returns a uint16_t containing calculated CRC16 value.
+    */
+    uint16_t crc16_bitwise(const uint8_t data[], size_t data_len)
+    {
+        uint16_t crc = 0xFFFF;
+        uint8_t j;
+
+        for (size_t i = 0; i < data_len; i++)
+        {
+            crc = crc ^ (((uint16_t)data[i]) << 8);
+            j = 0;
+            while (j++ < 8)
+            {
+                if (crc & 0x8000)
+                    crc = crc << 1 ^ 0x1021;
+                else
+                    crc = crc << 1;
+            }
+        }
+
+        return crc;
+    }
+
+    /**
+    * @name   crc16_table
+    * @brief  Byte-wise CRC16 using a 256 entry lookup table.
+    * @param  data -> Random byte array
+    * @param  data_len -> Length of data parameter
+    * @retval Returns a uint16_t containing calculated CRC16 value.
+    */
+    uint16_t crc16_table(const uint8_t data[], size_t data_len)
+    {
+        uint16_t crc = 0xFFFF;
+
+        for (size_t i = 0; i < data_len; i++)
+        {
+            crc = (crc << 8) ^ crc16_tables.table[0][(crc >> 8) ^ data[i]];
+        }
+
+        return crc;
+    }
+
+    /**
+    * @name   crc16_slice4
+    * @brief  Slicing-by-4 CRC16, four bytes per iteration using four
+    *         256 entry lookup tables. The remaining bytes are processed byte-wise.
+    * @param  data -> Random byte array
+    * @param  data_len -> Length of data parameter
+    * @retval Returns a uint16_t containing calculated CRC16 value.
+    */
+    uint16_t crc16_slice4(const uint8_t data[], size_t data_len)
+    {
+        uint16_t crc = 0xFFFF;
+        size_t i = 0;
+
+        for (; i + 4 <= data_len; i += 4)
+        {
+            crc = crc16_tables.table[3][(crc >> 8) ^ data[i]] ^
+                  crc16_tables.table[2][(crc & 0xFF) ^ data[i+1]] ^
+                  crc16_tables.table[1][data[i+2]] ^
+                  crc16_tables.table[0][data[i+3]];
+        }
+
+        for (; i < data_len; i++)
+        {
+            crc = (crc << 8) ^ crc16_tables.table[0][(crc >> 8) ^ data[i]];
+        }
+
+        return crc;
+    }
+
+#if defined(ARDUINO_ARCH_RP2040)
+    static int  crc_dma_channel = -1;
+    static bool crc_dma_failed;
+
+    /**
+    * @name   crc16_dma_sniff
+    * @brief  Stream the data through a DMA channel with the sniffer
+    *         configured for CRC16-CCITT.
+    * @param  data -> Random byte array
+    * @param  data_len -> Length of data parameter
+    * @retval Returns a uint16_t containing calculated CRC16 value.
+    */
+    static uint16_t crc16_dma_sniff(const uint8_t data[], size_t data_len)
+    {
+        static uint8_t dummy;
+        dma_channel_config config = dma_channel_get_default_config(crc_dma_channel);
+
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+        channel_config_set_read_increment(&config, true);
+        channel_config_set_write_increment(&config, false);
+        channel_config_set_sniff_enable(&config, true);
+
+        // Sniffer mode 0x2 = CRC16-CCITT
+        dma_sniffer_enable(crc_dma_channel, 0x2, true);
+        dma_hw->sniff_data = 0xFFFF;
+
+        dma_channel_configure(crc_dma_channel, &config, &dummy, data, data_len, true);
+        dma_channel_wait_for_finish_blocking(crc_dma_channel);
+
+        return (uint16_t)(dma_hw->sniff_data & 0xFFFF);
+    }
+#endif
+
+    /**
+    * @name   crc16_dma
+    * @brief  CRC16 calculated by the RP2040 DMA sniffer.
+    *         Short arrays, targets without the sniffer and a failed self test
+    *         on first use fall back to the byte-wise table implementation.
+    * @param  data -> Random byte array
+    * @param  data_len -> Length of data parameter
+    * @retval Returns a uint16_t containing calculated CRC16 value.
+    */
+    uint16_t crc16_dma(const uint8_t data[], size_t data_len)
+    {
+#if defined(ARDUINO_ARCH_RP2040)
+        if ((data_len >= CRC_DMA_MIN_LEN) && !crc_dma_failed)
+        {
+            if (crc_dma_channel < 0)
+            {
+                const uint8_t check[] = "123456789";
+
+                crc_dma_channel = dma_claim_unused_channel(false);
+                if ((crc_dma_channel < 0) || (crc16_dma_sniff(check, 9) != crc16_table(check, 9)))
+                {
+                    crc_dma_failed = true;
+                    return crc16_table(data, data_len);
+                }
+            }
+            return crc16_dma_sniff(data, data_len);
+        }
+#endif
+        return crc16_table(data, data_len);
+    }
+}
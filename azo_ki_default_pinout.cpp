@@ -9,7 +9,7 @@
  *                           E-mail: info@azoteq.com                          *
  *                                                                            *
  * ========================================================================== *
- * @file        iqs7220a.cpp                                                  *
+ * @file        azo_ki_default_pinout.cpp                                     *
  * @brief       Default pin definitions                                       *
  * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
  * @version     v0.0.2                                                        *
@@ -19,86 +19,28 @@
 
 namespace AZO_KEYBOARD_INTERFACE
 {
-    uint32_t default_r0_msk[] = {
-        1 << 18,
-        1 << 14,
-        1 << 7,
-        1 << 28
-    };
-
-    uint32_t default_r1_msk[] = {
-        1 << 17,
-        1 << 13,
-        1 << 8,
-        1 << 27
-    };
-
-    uint32_t default_r2_msk[] = {
-        1 << 16,
-        1 << 12,
-        1 << 9,
-        1 << 26,
-    };
-
-    uint32_t default_r3_msk[] = {
-        1 << 3,
-        1 << 11,
-        1 << 10,
-        1 << 22
-    };
-
-    uint32_t default_c0_msk[] = {
-        1 << 19,
-        1 << 15,
-        1 << 6,
-        1 << 1
-    };
-
-    uint32_t default_d0_msk[] = {
-        1 << 16,
-        1 << 13,
-        1 << 8,
-        1 << 10,
-        1 << 27,
-        1 << 22
-    };
-
-    uint32_t default_d1_msk[] = {
-        1 << 3,
-        1 << 12,
-        1 << 9,
-        1 << 11,
-        1 << 26,
-        1 << 21
-    };
-
-    uint32_t default_s0_msk[] = {
-        1 << 18,
-        1 << 15,
-        1 << 6,
-        1 << 1
-    };
-
-    uint32_t default_s1_msk[] = {
-        1 << 17,
-        1 << 14,
-        1 << 7,
-        1 << 28
-    };
-
-    pin_settings_t default_pin_settings = {
+    // Completed at compile time, no pin table is computed at run time
+    constexpr pin_settings_t default_pin_settings = pin_settings_make({
         .serial_baud_rate   = 115200,
         .i2c_clk            = 1000000,
         .pin_sda_0          = 4,
         .pin_scl_0          = 5,
-        .c0_msk             = default_c0_msk,
-        .r0_msk             = default_r0_msk,
-        .r1_msk             = default_r1_msk,
-        .r2_msk             = default_r2_msk,
-        .r3_msk             = default_r3_msk,
-        .s0_msk             = default_s0_msk,
-        .s1_msk             = default_s1_msk,
-        .d0_msk             = default_d0_msk,
-        .d1_msk             = default_d1_msk
-    };
+        .c0_msk             = {1 << 19, 1 << 15, 1 << 6,  1 << 1},
+        .r0_msk             = {1 << 18, 1 << 14, 1 << 7,  1 << 28},
+        .r1_msk             = {1 << 17, 1 << 13, 1 << 8,  1 << 27},
+        .r2_msk             = {1 << 16, 1 << 12, 1 << 9,  1 << 26},
+        .r3_msk             = {1 << 3,  1 << 11, 1 << 10, 1 << 22},
+        .s0_msk             = {1 << 18, 1 << 15, 1 << 6,  1 << 1},
+        .s1_msk             = {1 << 17, 1 << 14, 1 << 7,  1 << 28},
+        .d0_msk             = {1 << 16, 1 << 13, 1 << 8,  1 << 10, 1 << 27, 1 << 22},
+        .d1_msk             = {1 << 3,  1 << 12, 1 << 9,  1 << 11, 1 << 26, 1 << 21}
+    });
+
+    static_assert(((default_pin_settings.c0_upto[MAX_COLUMNS] | default_pin_settings.s0_upto[MAX_COLUMNS] |
+                    default_pin_settings.s1_upto[MAX_COLUMNS] | default_pin_settings.r0_upto[MAX_ROWS] |
+                    default_pin_settings.r1_upto[MAX_ROWS] | default_pin_settings.r2_upto[MAX_ROWS] |
+                    default_pin_settings.r3_upto[MAX_ROWS] | default_pin_settings.d0_upto[MAX_ROWS] |
+                    default_pin_settings.d1_upto[MAX_ROWS]) &
+                   ((1UL << default_pin_settings.pin_sda_0) | (1UL << default_pin_settings.pin_scl_0))) == 0,
+                  "Key scan lines must not use the I2C pins");
 }
\ No newline at end of file
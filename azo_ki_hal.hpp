@@ -0,0 +1,155 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_hal.hpp                                                *
+ * @brief       Hardware abstraction layer for GPIO and timing access.        *
+ *              The RP2040 backend accesses the SIO and pad registers         *
+ *              directly. The host backend (AZO_KI_HOST) is implemented       *
+ *              in extras/host and simulates the GPIO bank and clock.         *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+// hal_i2c_status() results
+enum hal_i2c_status_e
+{
+    hal_i2c_busy    = 0,
+    hal_i2c_done    = 1,
+    hal_i2c_nack    = 2
+};
+
+#if defined(AZO_KI_HOST)
+
+// Host backend - extras/host/azo_ki_host.cpp
+uint32_t    hal_gpio_input();
+void        hal_gpio_output_clear(uint32_t mask);
+void        hal_gpio_output_enable_set(uint32_t mask);
+void        hal_gpio_output_enable_clear(uint32_t mask);
+void        hal_gpio_pad_setup(uint8_t pin);
+uint64_t    hal_time_us();
+bool        hal_i2c_read_start(uint8_t address, const uint8_t reg[], uint8_t reg_len, uint8_t data[], uint8_t len);
+uint8_t     hal_i2c_status();
+void        hal_i2c_abort();
+
+#else
+
+// HW control register addresses
+#define HAL_GPIO_INPUT                  ((volatile uint32_t*)0xd0000004)
+#define HAL_GPIO_OUTPUT_CLEAR           ((volatile uint32_t*)0xd0000018)
+#define HAL_GPIO_OUTPUT_ENABLE_SET      ((volatile uint32_t*)0xd0000024)
+#define HAL_GPIO_OUTPUT_ENABLE_CLEAR    ((volatile uint32_t*)0xd0000028)
+#define HAL_IO_BANK0_CTRL_BASE          0x40014004
+#define HAL_PADS_BANK0_BASE             0x4001C004
+#define HAL_TIMER_RAWH                  ((volatile uint32_t*)0x40054024)
+#define HAL_TIMER_RAWL                  ((volatile uint32_t*)0x40054028)
+
+/**
+* @name   hal_gpio_input
+* @brief  Returns the current input level of all GPIO pins.
+* @param  None
+* @retval GPIO input register value
+*/
+static inline uint32_t hal_gpio_input()
+{
+    return *HAL_GPIO_INPUT;
+}
+
+/**
+* @name   hal_gpio_output_clear
+* @brief  Set the output level LOW for all pins in the mask.
+* @param  mask -> GPIO pin mask
+* @retval None
+*/
+static inline void hal_gpio_output_clear(uint32_t mask)
+{
+    *HAL_GPIO_OUTPUT_CLEAR = mask;
+}
+
+/**
+* @name   hal_gpio_output_enable_set
+* @brief  Enable the output driver for all pins in the mask.
+*         Pins are kept LOW, so this pulls the lines LOW.
+* @param  mask -> GPIO pin mask
+* @retval None
+*/
+static inline void hal_gpio_output_enable_set(uint32_t mask)
+{
+    *HAL_GPIO_OUTPUT_ENABLE_SET = mask;
+}
+
+/**
+* @name   hal_gpio_output_enable_clear
+* @brief  Disable the output driver for all pins in the mask.
+*         The internal pull-up resistors pull the lines HIGH.
+* @param  mask -> GPIO pin mask
+* @retval None
+*/
+static inline void hal_gpio_output_enable_clear(uint32_t mask)
+{
+    *HAL_GPIO_OUTPUT_ENABLE_CLEAR = mask;
+}
+
+/**
+* @name   hal_gpio_pad_setup
+* @brief  Configure a single pin as software controlled GPIO (SIO)
+*         with the internal pull-up resistor enabled.
+* @param  pin -> GPIO pin number
+* @retval None
+*/
+static inline void hal_gpio_pad_setup(uint8_t pin)
+{
+    uint32_t value;
+    uint32_t address;
+
+    // Set pin as software controlled GPIO
+    address = HAL_IO_BANK0_CTRL_BASE + pin*8;
+    value = *(volatile uint32_t*)(address);
+    value &= 0xFFFFFFE0;
+    value |= 5;
+    *(volatile uint32_t*)(address) = value;
+
+    // Enable internal pullup resistor
+    address = HAL_PADS_BANK0_BASE + pin*4;
+    value = *(volatile uint32_t*)(address);
+    value |= (1 << 3);
+    *(volatile uint32_t*)(address) = value;
+}
+
+/**
+* @name   hal_time_us
+* @brief  Returns the free running 64-bit microsecond timer value.
+* @param  None
+* @retval Microseconds since boot
+*/
+static inline uint64_t hal_time_us()
+{
+    uint32_t high, low;
+
+    // Re-read when the high word rolled over between reads
+    do
+    {
+        high = *HAL_TIMER_RAWH;
+        low  = *HAL_TIMER_RAWL;
+    } while (high != *HAL_TIMER_RAWH);
+
+    return ((uint64_t)high << 32) | low;
+}
+
+// I2C0 with DMA - azo_ki_i2c.cpp
+bool        hal_i2c_read_start(uint8_t address, const uint8_t reg[], uint8_t reg_len, uint8_t data[], uint8_t len);
+uint8_t     hal_i2c_status();
+void        hal_i2c_abort();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,433 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_i2c.cpp                                                *
+ * @brief       Queue of non-blocking I2C register reads. Transfers run on    *
+ *              the RP2040 I2C0 peripheral driven by DMA while serial is      *
+ *              serviced, with a blocking Wire fallback. Every transfer is    *
+ *              bounded by I2C_TIMEOUT, errors are counted per device and a   *
+ *              stuck bus is recovered with SCL pulses.                       *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include "azo_ki.hpp"
+
+#if defined(ARDUINO_ARCH_RP2040)
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+#endif
+
+#if !defined(AZO_KI_HOST)
+#if defined(ARDUINO_ARCH_RP2040)
+static int      i2c_dma_tx = -1;
+static int      i2c_dma_rx = -1;
+static bool     i2c_dma_failed;
+static uint16_t i2c_dma_cmd[2 + 255];   // Register address writes and read commands
+
+/**
+* @name   hal_i2c_read_start
+* @brief  Start a register read on I2C0. The register address is written,
+*         followed by a repeated start and the read. A TX DMA channel feeds the
+*         commands to IC_DATA_CMD and an RX DMA channel stores the data.
+* @param  address -> 7-bit I2C address
+* @param  reg -> Register address, LSB first
+* @param  reg_len -> Bytes in the register address
+* @param  data -> Receives the register data, must remain valid until done
+* @param  len -> Number of bytes to read
+* @retval Returns false if the DMA channels are not available.
+*/
+bool hal_i2c_read_start(uint8_t address, const uint8_t reg[], uint8_t reg_len, uint8_t data[], uint8_t len)
+{
+    i2c_hw_t *hw = i2c_get_hw(i2c0);
+    dma_channel_config config;
+    uint16_t n = 0;
+
+    if (i2c_dma_failed || (len == 0)) return false;
+    if (i2c_dma_tx < 0)
+    {
+        i2c_dma_tx = dma_claim_unused_channel(false);
+        i2c_dma_rx = dma_claim_unused_channel(false);
+        if ((i2c_dma_tx < 0) || (i2c_dma_rx < 0))
+        {
+            i2c_dma_failed = true;
+            return false;
+        }
+    }
+
+    for (uint8_t i = 0; i < reg_len; i++)
+    {
+        i2c_dma_cmd[n++] = reg[i];
+    }
+    for (uint8_t i = 0; i < len; i++)
+    {
+        i2c_dma_cmd[n++] = I2C_IC_DATA_CMD_CMD_BITS |
+                           ((i == 0) ? I2C_IC_DATA_CMD_RESTART_BITS : 0) |
+                           ((i == len - 1) ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    }
+
+    hw->enable = 0;
+    hw->tar = address;
+    hw->enable = 1;
+    (void)hw->clr_tx_abrt;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+
+    config = dma_channel_get_default_config(i2c_dma_rx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    channel_config_set_dreq(&config, DREQ_I2C0_RX);
+    dma_channel_configure(i2c_dma_rx, &config, data, &hw->data_cmd, len, true);
+
+    config = dma_channel_get_default_config(i2c_dma_tx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, DREQ_I2C0_TX);
+    dma_channel_configure(i2c_dma_tx, &config, &hw->data_cmd, i2c_dma_cmd, n, true);
+
+    return true;
+}
+
+/**
+* @name   hal_i2c_status
+* @brief  State of the read started by hal_i2c_read_start().
+* @param  None
+* @retval Returns hal_i2c_busy, hal_i2c_done or hal_i2c_nack (transfer aborted).
+*/
+uint8_t hal_i2c_status()
+{
+    i2c_hw_t *hw = i2c_get_hw(i2c0);
+
+    if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS)
+    {
+        dma_channel_abort(i2c_dma_tx);
+        dma_channel_abort(i2c_dma_rx);
+        (void)hw->clr_tx_abrt;
+        hw->dma_cr = 0;
+        return hal_i2c_nack;
+    }
+    if (dma_channel_is_busy(i2c_dma_rx)) return hal_i2c_busy;
+
+    hw->dma_cr = 0;
+    return hal_i2c_done;
+}
+
+/**
+* @name   hal_i2c_abort
+* @brief  Abort the read started by hal_i2c_read_start(). The DMA channels are
+*         stopped and the I2C0 FIFOs are flushed by disabling the peripheral.
+* @param  None
+* @retval None
+*/
+void hal_i2c_abort()
+{
+    i2c_hw_t *hw = i2c_get_hw(i2c0);
+
+    dma_channel_abort(i2c_dma_tx);
+    dma_channel_abort(i2c_dma_rx);
+    hw->dma_cr = 0;
+    hw->enable = 0;
+    (void)hw->clr_tx_abrt;
+}
+#else
+bool hal_i2c_read_start(uint8_t address, const uint8_t reg[], uint8_t reg_len, uint8_t data[], uint8_t len)
+{
+    (void)address; (void)reg; (void)reg_len; (void)data; (void)len;
+    return false;
+}
+
+uint8_t hal_i2c_status()
+{
+    return hal_i2c_done;
+}
+
+void hal_i2c_abort()
+{
+}
+#endif
+#endif
+
+namespace AZO_KEYBOARD_INTERFACE
+{
+    /**
+    * @name   i2c_submit
+    * @brief  Queue a register read from the device at i2c_control.device_addr.
+    *         The read starts immediately when the bus is idle. Its errors are
+    *         counted against i2c_device at the time it is queued.
+    * @param  reg -> Register address, LSB first
+    * @param  reg_len -> Bytes in the register address (1 or 2)
+    * @param  data -> Receives the register data, must remain valid until i2c_wait() returns
+    * @param  len -> Number of bytes to read
+    * @retval Returns false if the queue is full.
+    */
+    bool KeyboardInterface::i2c_submit(const uint8_t reg[], uint8_t reg_len, uint8_t data[], uint8_t len)
+    {
+        i2c_transaction_t *transaction;
+
+        if (this->i2c_queue_len >= I2C_QUEUE_LEN) return false;
+
+        transaction = &(this->i2c_queue[(this->i2c_queue_head + this->i2c_queue_len) % I2C_QUEUE_LEN]);
+        transaction->device = this->i2c_device;
+        transaction->address = this->i2c_control.device_addr;
+        transaction->reg[0] = reg[0];
+        transaction->reg[1] = (reg_len > 1) ? reg[1] : 0;
+        transaction->reg_len = reg_len;
+        transaction->data = data;
+        transaction->len = len;
+        this->i2c_queue_len++;
+
+        this->i2c_service();
+        return true;
+    }
+
+    /**
+    * @name   i2c_service
+    * @brief  Complete the read in progress and start the next queued read.
+    *         Reads that cannot run on the DMA backend are done with Wire.
+    *         A read still busy after I2C_TIMEOUT is aborted and the bus recovered.
+    * @param  None
+    * @retval Returns true while reads are in progress or queued.
+    */
+    bool KeyboardInterface::i2c_service()
+    {
+        while (this->i2c_queue_len > 0)
+        {
+            i2c_transaction_t *transaction = &(this->i2c_queue[this->i2c_queue_head]);
+
+            if (this->i2c_queue_active)
+            {
+                uint8_t status = hal_i2c_status();
+
+                if (status == hal_i2c_busy)
+                {
+                    if (hal_time_us() < this->i2c_queue_deadline) return true;
+                    hal_i2c_abort();
+                    this->i2c_error(config_i2c_timeout, transaction->device);
+                }
+                else if (status == hal_i2c_nack)
+                {
+                    this->i2c_error(config_i2c_nack, transaction->device);
+                }
+                this->i2c_queue_active = false;
+            }
+            else if (hal_i2c_read_start(transaction->address, transaction->reg, transaction->reg_len,
+                                        transaction->data, transaction->len))
+            {
+                this->i2c_queue_active = true;
+                this->i2c_queue_deadline = hal_time_us() + I2C_TIMEOUT*1000;
+                return true;
+            }
+            else
+            {
+                this->i2c_read_blocking(transaction);
+            }
+
+            this->i2c_queue_head = (this->i2c_queue_head + 1) % I2C_QUEUE_LEN;
+            this->i2c_queue_len--;
+        }
+        return false;
+    }
+
+    /**
+    * @name   i2c_wait
+    * @brief  Wait for all queued reads to complete. The serial port keeps sending
+    *         and receiving while the bus is busy.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::i2c_wait()
+    {
+        while (this->i2c_service())
+        {
+            this->serial_service();
+        }
+    }
+
+    /**
+    * @name   i2c_read_blocking
+    * @brief  Register read with Wire, the CPU waits for the transfer to complete.
+    * @param  transaction -> Read to execute
+    * @retval None
+    */
+    void KeyboardInterface::i2c_read_blocking(const i2c_transaction_t *transaction)
+    {
+        uint8_t index = 0;
+        uint8_t device = this->i2c_device;
+
+        // Errors are counted against the device the read was queued for
+        this->i2c_device = transaction->device;
+
+        // Transmit I2C register that must be read from
+        Wire.beginTransmission(transaction->address);
+        Wire.write(transaction->reg, transaction->reg_len);
+        this->i2c_end(false);
+
+        // Receive I2C data
+        this->i2c_request(transaction->address, transaction->len);
+        while (Wire.available())
+        {
+            transaction->data[index] = Wire.read();
+            index++;
+            if (index >= transaction->len) break;
+        }
+
+        this->i2c_device = device;
+    }
+
+    /**
+    * @name   i2c_begin
+    * @brief  Start Wire on the I2C pins. Every Wire transfer times out after
+    *         I2C_TIMEOUT, after which Wire resets the peripheral.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::i2c_begin()
+    {
+        Wire.setSDA(this->pin_settings.pin_sda_0);
+        Wire.setSCL(this->pin_settings.pin_scl_0);
+        Wire.begin();
+        Wire.setClock(this->pin_settings.i2c_clk);
+        Wire.setTimeout(I2C_TIMEOUT, true);
+    }
+
+    /**
+    * @name   i2c_end
+    * @brief  End a Wire write transfer and record a failure against i2c_device.
+    * @param  stop -> Send a stop condition, false for a repeated start
+    * @retval Returns false if the transfer was not acknowledged or timed out.
+    */
+    bool KeyboardInterface::i2c_end(bool stop)
+    {
+        uint8_t result = Wire.endTransmission(stop);
+
+        // 2 = address NACK, 3 = data NACK, 4 = bus error, 5 = timeout
+        this->i2c_write_failed = (result != 0);
+        if ((result == 2) || (result == 3))
+        {
+            this->i2c_error(config_i2c_nack, this->i2c_device);
+        }
+        else if (result != 0)
+        {
+            this->i2c_error(config_i2c_timeout, this->i2c_device);
+        }
+        return !this->i2c_write_failed;
+    }
+
+    /**
+    * @name   i2c_request
+    * @brief  Read from a device with Wire. The read is skipped when the register
+    *         address write before it failed, so a transfer takes at most one timeout.
+    * @param  address -> 7-bit I2C address
+    * @param  len -> Number of bytes to read
+    * @retval Returns the number of bytes received.
+    */
+    uint8_t KeyboardInterface::i2c_request(uint8_t address, uint8_t len)
+    {
+        uint8_t received = 0;
+
+        if (!this->i2c_write_failed)
+        {
+            received = Wire.requestFrom(address, len);
+            if (received < len) this->i2c_error(config_i2c_nack, this->i2c_device);
+        }
+        this->i2c_write_failed = false;
+        return received;
+    }
+
+    /**
+    * @name   i2c_error
+    * @brief  Raise an I2C error flag for the status command and the stream frame in
+    *         progress, and count it against the device of the failed transfer. The
+    *         register shadow of the device is dropped. A timeout recovers the bus.
+    * @param  status -> config_i2c_nack or config_i2c_timeout
+    * @param  device_index -> Device of the failed transfer, 0xFF outside the device matrix
+    * @retval None
+    */
+    void KeyboardInterface::i2c_error(uint8_t status, uint8_t device_index)
+    {
+        device_errors_t *errors = this->i2c_device_errors(device_index);
+
+        this->config_status |= status;
+        this->stream_frame_status |= status;
+
+        // The device registers are unknown after a failed transfer
+        if (device_index < MAX_DEVICES) this->cache_invalidate(device_index);
+
+        if (status == config_i2c_nack)
+        {
+            if (errors->nack < 0xFFFF) errors->nack++;
+        }
+        else
+        {
+            if (errors->bus_timeout < 0xFFFF) errors->bus_timeout++;
+            this->i2c_bus_recover();
+        }
+    }
+
+    /**
+    * @name   i2c_bus_recover
+    * @brief  Release a device that holds SDA LOW in the middle of a transfer.
+    *         SCL is clocked up to I2C_RECOVER_PULSES times until SDA is HIGH,
+    *         followed by a stop condition, after which Wire is restarted.
+    *         Takes at most (2*I2C_RECOVER_PULSES + 4)*I2C_RECOVER_DELAY.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::i2c_bus_recover()
+    {
+        uint32_t sda = 1UL << this->pin_settings.pin_sda_0;
+        uint32_t scl = 1UL << this->pin_settings.pin_scl_0;
+
+        Wire.end();
+        hal_gpio_pad_setup(this->pin_settings.pin_sda_0);
+        hal_gpio_pad_setup(this->pin_settings.pin_scl_0);
+        hal_gpio_output_clear(sda | scl);
+        hal_gpio_output_enable_clear(sda | scl);
+
+        for (uint8_t i = 0; (i < I2C_RECOVER_PULSES) && !(hal_gpio_input() & sda); i++)
+        {
+            // SCL LOW
+            hal_gpio_output_enable_set(scl);
+            this->settle_wait(hal_time_us() + I2C_RECOVER_DELAY);
+
+            // SCL HIGH
+            hal_gpio_output_enable_clear(scl);
+            this->settle_wait(hal_time_us() + I2C_RECOVER_DELAY);
+        }
+
+        // Stop condition, SDA rises while SCL is HIGH
+        hal_gpio_output_enable_set(scl);
+        this->settle_wait(hal_time_us() + I2C_RECOVER_DELAY);
+        hal_gpio_output_enable_set(sda);
+        this->settle_wait(hal_time_us() + I2C_RECOVER_DELAY);
+        hal_gpio_output_enable_clear(scl);
+        this->settle_wait(hal_time_us() + I2C_RECOVER_DELAY);
+        hal_gpio_output_enable_clear(sda);
+        this->settle_wait(hal_time_us() + I2C_RECOVER_DELAY);
+
+        this->i2c_begin();
+        if (this->i2c_recoveries < 0xFFFF) this->i2c_recoveries++;
+    }
+
+    /**
+    * @name   i2c_device_errors
+    * @brief  Error counters of a device in the device matrix.
+    * @param  device_index -> Device index, column*num_rows + row
+    * @retval Returns the counters of devices outside the device matrix for an index
+    *         outside the matrix.
+    */
+    device_errors_t* KeyboardInterface::i2c_device_errors(uint8_t device_index)
+    {
+        if (device_index < this->num_columns*this->num_rows) return &(this->device_errors[device_index]);
+        return &(this->device_errors_outside);
+    }
+}
\ No newline at end of file
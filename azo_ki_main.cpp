@@ -18,14 +18,10 @@
  *****************************************************************************/
 #include "azo_ki.hpp"
 
-// HW control register addresses
-uint32_t* gpio_input               = (uint32_t*)0xd0000004;
-uint32_t* gpio_output              = (uint32_t*)0xd0000010;
-uint32_t* gpio_output_set          = (uint32_t*)0xd0000014;
-uint32_t* gpio_output_clear        = (uint32_t*)0xd0000018;
-uint32_t* gpio_output_enable       = (uint32_t*)0xd0000020;
-uint32_t* gpio_output_enable_set   = (uint32_t*)0xd0000024;
-uint32_t* gpio_output_enable_clear = (uint32_t*)0xd0000028;
+static_assert(MAX_DEVICES <= 64, "Key scan bitplanes hold one bit per device");
+// Largest matrix of the largest device family, with alignment padding of each of the 5 tables
+static_assert(MAX_DEVICES*(sizeof(AZO_KEYBOARD_INTERFACE::device_errors_t) + 2) + 2*AZQ701_KS_OUTPUT_PARAMS*sizeof(uint64_t) + 5*8 <= MATRIX_ARENA_LEN,
+              "Matrix arena does not hold the largest device matrix");
 
 // Default serial return values
 uint8_t return_arr[4] = {0xFF, 0xFF, 0xFF, 0xFF};
@@ -35,14 +31,15 @@ namespace AZO_KEYBOARD_INTERFACE
     /**
     * @name   KeyboardInterface
     * @brief  Specialised constructor for the KeyboardInterface class
-    *         Will use the pin_settings_param instance to define the GPIO selection
+    *         Will use the pin_settings_param instance to define the GPIO selection,
+    *         the pin tables derived from the masks are completed here
     * @param  pin_settings_param -> Define GPIO selection for Serial baudrate, I2C clock speed, 
     *                               I2C pin selection, key scan pin selection
     * @retval None
     */
     KeyboardInterface::KeyboardInterface(pin_settings_t pin_settings_param)
     {
-        this->pin_settings = pin_settings_param;
+        this->pin_settings = pin_settings_make(pin_settings_param);
     }
 
     /**
@@ -66,16 +63,47 @@ namespace AZO_KEYBOARD_INTERFACE
     void KeyboardInterface::comms_setup()
     {
         Serial.begin(this->pin_settings.serial_baud_rate);
-        Wire.setSDA(this->pin_settings.pin_sda_0);
-        Wire.setSCL(this->pin_settings.pin_scl_0);
-        Wire.begin();
-        Wire.setClock(this->pin_settings.i2c_clk);
+        this->serial_rx_head        = 0;
+        this->serial_rx_tail        = 0;
+        this->serial_rx_consumed    = 0;
+        this->serial_rx_state       = rx_await_header_a;
+        this->serial_tx_len[0]      = 0;
+        this->serial_tx_len[1]      = 0;
+        this->serial_tx_index       = 0;
+        this->serial_tx_active      = 0;
+        this->serial_packet_pending = false;
+        this->scan_control.state    = scan_idle;
+        memset(this->scan_delay, SCAN_DELAY, sizeof(this->scan_delay));
+        this->config_status         = config_ok;
+        this->config_timeouts       = 0;
+        this->stream_frame_status   = config_ok;
+        this->i2c_queue_head        = 0;
+        this->i2c_queue_len         = 0;
+        this->i2c_queue_active      = false;
+        this->i2c_device            = 0xFF;
+        this->i2c_write_failed      = false;
+        this->i2c_recoveries        = 0;
+        this->setup_complete        = false;
+        this->num_columns           = 0;
+        this->num_rows              = 0;
+        this->matrix_arena_len      = 0;
+        memset(&(this->device_errors_outside), 0, sizeof(this->device_errors_outside));
+        memset(&(this->register_cache), 0, sizeof(this->register_cache));
+        this->i2c_begin();
+
+#if defined(AZO_KI_DUAL_CORE)
+        this->comms_ready.store(true, std::memory_order_release);
+#endif
     }
 
     /**
     * @name   device_setup
     * @brief  Setup the number of devices in the device matrix and 
-    *         configure the selected GPIO pins for a given device
+    *         configure the selected GPIO pins for a given device.
+    *         The per device tables and the key scan bitplanes are taken from the
+    *         matrix arena, sized for the given matrix. A matrix larger than the
+    *         pinout wires for the device family, or than the arena holds, is not
+    *         set up and commands stay disabled until a valid setup.
     * @param  device        -> Device type selection (IQS9320, IQS7220A, IQS7320A)
     * @param  num_columns   -> Number of column in the device matrix
     * @param  num_rows      -> Number of rows in the device matrix
@@ -83,9 +111,73 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::device_setup(device_e device, uint8_t num_columns, uint8_t num_rows)
     {
+        uint8_t max_columns = MAX_COLUMNS;
+        uint8_t max_rows = MAX_ROWS;
+        uint8_t num_planes = 0;
+        uint8_t num_devices;
+
+        switch (device)
+        {
+        case device_e::dev_iqs7220a:
+        case device_e::dev_iqs7320a:
+            max_columns = this->pin_settings.iqs7x20a_columns;
+            max_rows = this->pin_settings.iqs7x20a_rows;
+            num_planes = AZQ700_KS_OUTPUT_PARAMS;
+            break;
+
+        case device_e::dev_iqs9320_ks:
+            max_columns = this->pin_settings.iqs9320_columns;
+            max_rows = this->pin_settings.iqs9320_rows;
+            num_planes = AZQ701_KS_OUTPUT_PARAMS;
+            break;
+
+        default:
+            break;
+        }
+
+        // Commands and streams stay disabled until a valid setup
+        this->setup_complete = false;
+        if ((num_columns == 0) || (num_rows == 0) || (num_columns > max_columns) || (num_rows > max_rows)) return;
+
+        // A new device family or matrix invalidates the register shadow, repeating
+        // the setup after a reconnect keeps it
+        if ((device != this->device) || (num_columns != this->num_columns) || (num_rows != this->num_rows))
+        {
+            this->cache_invalidate(0xFF);
+        }
+
+        // Storage of the previous setup is given back, the tables are only used
+        // for device indices inside the matrix
+        num_devices = num_columns*num_rows;
+        this->num_columns = 0;
+        this->num_rows = 0;
+        this->matrix_arena_len = 0;
+        this->device_errors = (device_errors_t*)this->matrix_alloc(num_devices*sizeof(device_errors_t));
+        this->device_row = (uint8_t*)this->matrix_alloc(num_devices);
+        this->device_column = (uint8_t*)this->matrix_alloc(num_devices);
+        this->key_scan_planes = (uint64_t*)this->matrix_alloc(num_planes*sizeof(uint64_t));
+        this->key_scan_previous = (uint64_t*)this->matrix_alloc(num_planes*sizeof(uint64_t));
+        if ((this->device_errors == nullptr) || (this->device_row == nullptr) || (this->device_column == nullptr) ||
+            (this->key_scan_planes == nullptr) || (this->key_scan_previous == nullptr))
+        {
+            return;
+        }
+
         this->device        = device;
         this->num_columns   = num_columns;
         this->num_rows      = num_rows;
+        this->key_scan_num_planes = num_planes;
+        memset(this->device_errors, 0, num_devices*sizeof(device_errors_t));
+        memset(&(this->device_errors_outside), 0, sizeof(this->device_errors_outside));
+        memset(this->key_scan_planes, 0, num_planes*sizeof(uint64_t));
+        memset(this->key_scan_previous, 0, num_planes*sizeof(uint64_t));
+
+        // Row and column of every device index, so that I2C accesses do not divide
+        for (uint8_t i = 0; i < num_devices; i++)
+        {
+            this->device_column[i] = i/num_rows;
+            this->device_row[i] = i - this->device_column[i]*num_rows;
+        }
 
         // Configure the GPIO pins for given device
         switch (device)
@@ -110,180 +202,172 @@ namespace AZO_KEYBOARD_INTERFACE
         this->setup_complete = true;
     }
 
+    /**
+    * @name   matrix_alloc
+    * @brief  Take storage for the device matrix from the matrix arena. The arena is
+    *         emptied by every device setup, storage is 8 byte aligned.
+    * @param  len -> Bytes to take
+    * @retval Returns nullptr if the arena does not have len bytes left.
+    */
+    void* KeyboardInterface::matrix_alloc(uint16_t len)
+    {
+        uint16_t offset = (this->matrix_arena_len + 7) & ~7;
+
+        if ((uint32_t)offset + len > MATRIX_ARENA_LEN) return nullptr;
+        this->matrix_arena_len = offset + len;
+        return &(this->matrix_arena[offset]);
+    }
+
     /**
     * @name   get_device_row
-    * @brief  Returns the row of the device index that is given
+    * @brief  Returns the row of the device index that is given.
+    *         Devices of the matrix are looked up in the table filled by the device setup.
     * @param  device_select -> The index of the device
     * @retval Returns the row number of the device given as parameter
     */
     uint8_t KeyboardInterface::get_device_row(uint8_t device_select)
     {
+        if (device_select < this->num_columns*this->num_rows) return this->device_row[device_select];
         return device_select%this->num_rows;
     }
 
     /**
     * @name   get_device_column
-    * @brief  Returns the column of the device index that is given
+    * @brief  Returns the column of the device index that is given.
+    *         Devices of the matrix are looked up in the table filled by the device setup.
     * @param  device_select -> The index of the device
     * @retval Returns the column number of the device given as parameter
     */
     uint8_t KeyboardInterface::get_device_column(uint8_t device_select)
     {
+        if (device_select < this->num_columns*this->num_rows) return this->device_column[device_select];
         return device_select > 0 ? (uint8_t)(device_select/this->num_rows) : 0;
     }
 
     /**
     * @name   do_comms
     * @brief  Only function required in main loop of the application.
-    *         Will first read the serial buffer to verify if any serial communications
-    *         need to be processed. If the serial buffer is empty the byte array containing
-    *         serial data will be analyzed to verify if a valid packet has been received.
+    *         Responses are assembled in one of two TX buffers and handed over
+    *         to be sent once complete, while the next response is built.
+    *         Will first move all bytes waiting in the serial buffer to the receive
+    *         ring buffer and parse them up to the end of the next packet.
+    *         In single core builds the engine runs next, see do_engine().
+    *         In AZO_KI_DUAL_CORE builds this is the core 0 loop: a received packet
+    *         is queued on command_ring for the engine on core 1, and the responses
+    *         core 1 writes to output_ring are moved to the TX buffers.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::do_comms()
+    {
+        // Continue sending the previous response
+        this->write_serial();
+
+        // Receive all bytes waiting in the serial buffer
+        this->read_serial();
+
+        // Parse the next packet once the previous one has been taken
+        if (!this->serial_packet_pending) this->serial_packet_pending = this->test_for_packet();
+
+#if defined(AZO_KI_DUAL_CORE)
+        if (this->serial_packet_pending)
+        {
+            // Length prefixed record, retried on the next call while the ring is full
+            uint8_t record[PACKET_LEN + 1];
+            record[0] = this->serial_rx_packet_len;
+            memcpy(&(record[1]), this->serial_rx_packet, this->serial_rx_packet_len);
+            if (this->command_ring.push(record, this->serial_rx_packet_len + 1)) this->serial_packet_pending = false;
+        }
+
+        this->serial_tx_drain();
+#else
+        this->do_engine();
+#endif
+    }
+
+    /**
+    * @name   do_engine
+    * @brief  Execute received commands and sample the streams. Called from
+    *         do_comms() in single core builds, and from the core 1 loop in
+    *         AZO_KI_DUAL_CORE builds.
     *         If a valid packet has been received the device will execute the given command.
     *         If a valid packet has not been received, or if no packet data is available,
-    *         the device will attempt to execute a streaming function that will periodically
-    *         send data over serial. Multiple streaming configurations can be used to stream 
-    *         data from the 3 supported devices.
+    *         the device will sample the stream with the earliest deadline once it is due.
+    *         Up to MAX_STREAM streams with independent intervals can be active at the
+    *         same time. Every sample is sent in sequence numbered stream frames.
+    *         Key scan streams are stepped one phase per call while the matrix lines
+    *         settle, serial is received, parsed and sent in the meantime.
     * @param  None
     * @retval None
     */
-    void KeyboardInterface::do_comms()
+    void KeyboardInterface::do_engine()
     {
-        // Only execute code when not receiving serial communication
-        if (! this->read_serial())
+        // A stream key scan in progress owns the matrix lines and the stream frame,
+        // a received packet is executed once the scan has completed
+        if (this->scan_control.state != scan_idle)
         {
-            // If a serial packet was received execute the instruction
-            if (this->test_for_packet())
+            // Step the scan once the lines have settled, send the sample when complete
+            if ((hal_time_us() >= this->scan_control.deadline) && this->scan_step())
             {
-                this->do_command();
+                this->scan_output();
+                this->stream_frame_end();
+                this->output_flush();
             }
+            return;
+        }
 
-            // If no serial packet was received then stream data
-            else
-            {
-                // Do not stream data when device setup has not been completed
-                if (!this->setup_complete) return;
+        // If a serial packet was received execute the instruction
+        if (this->command_next())
+        {
+            this->do_command();
+            this->output_flush();
+        }
 
-                // Only consider streaming when no serial bytes (partial packets) have been received
-                if (serial_input_index == 0)
-                {
-                    // Return if not enough milliseconds have passed since previous sample
-                    if (millis() - this->stream_control.timestamp < this->stream_control.sample_interval) return;
-                    this->stream_control.timestamp = millis();
+        // If no serial packet was received then stream data
+        else
+        {
+            // Do not stream data when device setup has not been completed
+            if (!this->setup_complete) return;
 
-                    switch (this->stream_control.state)
-                    {
-                        case stream_disabled:
-                            break;
-
-                        case stream_iqs7220a_ks:
-                            this->iqs7220a_scan_keys_all();
-                            break;
-
-                        case stream_iqs7220a_i2c:
-                            // Stream from all devices in matrix
-                            if (this->stream_control.device_select == 0xFF)
-                            {
-                                for (uint8_t i = 0; i < this->stream_control.num_registers; i++)
-                                {
-                                    this->i2c_control.register_addr_lsb = this->stream_control.addr[i];
-                                    this->i2c_control.data_len = this->stream_control.len[i];
-                                    this->iqs7220a_i2c_read_multi();
-                                }
-                            }
-                            else
-                            // Stream from specific device only
-                            {
-                                this->i2c_control.device_select = this->stream_control.device_select;
-                                for (uint8_t i = 0; i < this->stream_control.num_registers; i++)
-                                {
-                                    this->i2c_control.register_addr_lsb = this->stream_control.addr[i];
-                                    this->i2c_control.data_len = this->stream_control.len[i];
-                                    this->iqs7220a_i2c_read_single();
-                                }
-                            }
-                            break;
-
-                        case stream_iqs7320a_ks:
-                            this->iqs7320a_scan_keys_all();
-                            break;
-
-                        case stream_iqs7320a_i2c:
-                            // Stream from all devices in matrix
-                            if (this->stream_control.device_select == 0xFF)
-                            {
-                                for (uint8_t i = 0; i < this->stream_control.num_registers; i++)
-                                {
-                                    this->i2c_control.register_addr_lsb = this->stream_control.addr[i];
-                                    this->i2c_control.data_len = this->stream_control.len[i];
-                                    this->iqs7320a_i2c_read_multi();
-                                }
-                            }
-                            else
-                            // Stream from specific device only
-                            {
-                                this->i2c_control.device_select = this->stream_control.device_select;
-                                for (uint8_t i = 0; i < this->stream_control.num_registers; i++)
-                                {
-                                    this->i2c_control.register_addr_lsb = this->stream_control.addr[i];
-                                    this->i2c_control.data_len = this->stream_control.len[i];
-                                    this->iqs7320a_i2c_read_single();
-                                }
-                            }
-                            break;
-
-                        case stream_iqs9320_i2c:
-                            for (uint8_t i = 0; i < this->stream_control.num_registers; i++)
-                            {
-                                for (uint8_t j = 0; j < this->stream_control.num_devices; j++)
-                                {
-                                    this->i2c_control.device_addr = this->stream_control.device_addr[j];
-                                    this->i2c_control.register_addr_lsb = this->stream_control.addr[(2*i)];
-                                    this->i2c_control.register_addr_msb = this->stream_control.addr[(2*i)+1];
-                                    this->i2c_control.data_len = this->stream_control.len[i];
-                                    this->iqs9320_i2c_read_fp();
-                                }
-                            }
-                            break;
-
-                        case stream_iqs9320_ks:
-                            this->iqs9320_scan_keys_all(this->stream_control.num_channels);
-                            break;
-
-                        case stream_iqs9320_ks_i2c:
-                            // Stream from all devices in device matrix
-                            if (this->stream_control.device_select == 0xFF)
-                            {
-                                for (uint8_t i = 0; i < this->stream_control.num_registers; i++)
-                                {
-                                    this->i2c_control.register_addr_lsb = this->stream_control.addr[(2*i)];
-                                    this->i2c_control.register_addr_msb = this->stream_control.addr[(2*i)+1];
-                                    this->i2c_control.data_len = this->stream_control.len[i];
-                                    for (uint8_t j = 0; j < num_columns*num_rows; j++)
-                                    {
-                                        this->i2c_control.device_select = j;
-                                        this->iqs9320_i2c_read_ks();
-                                    }
-                                }
-                            }
-                            else
-                            // Stream from specific device only
-                            {
-                                this->i2c_control.device_select = this->stream_control.device_select;
-                                for (uint8_t i = 0; i < this->stream_control.num_registers; i++)
-                                {
-                                    this->i2c_control.register_addr_lsb = this->stream_control.addr[(2*i)];
-                                    this->i2c_control.register_addr_msb = this->stream_control.addr[(2*i)+1];
-                                    this->i2c_control.data_len = this->stream_control.len[i];
-                                    this->iqs9320_i2c_read_ks();
-                                }
-                            }
-                            break;
-                    }
-                }
-            }
+            // Sample the stream with the earliest deadline once it is due, a key scan
+            // stream is sent once its scan has completed
+            if (this->stream_schedule() && (this->scan_control.state == scan_idle)) this->output_flush();
         }
     }
 
+    /**
+    * @name   command_next
+    * @brief  Take the next received packet for execution, serial_packet_data and
+    *         serial_packet_len hold it until the next call. In AZO_KI_DUAL_CORE builds
+    *         the packet is copied out of command_ring and acknowledged here, so that
+    *         the acknowledge is sent in order with the responses.
+    * @param  None
+    * @retval Returns false if no packet is waiting.
+    */
+    bool KeyboardInterface::command_next()
+    {
+#if defined(AZO_KI_DUAL_CORE)
+        uint8_t len = 0;
+
+        // Records are pushed whole, the packet follows its length byte
+        if (this->command_ring.available() == 0) return false;
+        this->command_ring.read(&len, 1);
+        this->command_ring.read(this->serial_command, len);
+
+        this->serial_packet_data = this->serial_command;
+        this->serial_packet_len = len;
+        this->send_packet_response(this->serial_packet_data);
+#else
+        if (!this->serial_packet_pending) return false;
+        this->serial_packet_pending = false;
+
+        this->serial_packet_data = this->serial_rx_packet;
+        this->serial_packet_len = this->serial_rx_packet_len;
+#endif
+        this->serial_comms_state = true;
+        return true;
+    }
+
     /**
     * @name   do_command
     * @brief  Execute commands that have been received over serial.
@@ -295,6 +379,8 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::do_command()
     {
+        stream_control_t *stream;
+
         switch(this->serial_packet_data[1])
         {
             // ---------------------------------------------------------
@@ -305,13 +391,154 @@ namespace AZO_KEYBOARD_INTERFACE
                 break;
 
             case cmd_stop_streaming:
-                this->stream_control.state = stream_disabled;
+                // Optional parameter selects a single stream slot
+                if (this->serial_packet_len > 2)
+                    this->stream_stop(this->serial_packet_data[2]);
+                else
+                    this->stream_stop_all();
                 break;
 
             case cmd_stop_comms:
                 this->serial_comms_state = false;
                 break;
 
+            case cmd_stream_ks_mode:
+                // Delta mode keeps a single previous sample, not selected while key scan streams share it
+                if ((this->serial_packet_data[2] == stream_ks_delta) && (this->stream_ks_others(cmd_stream_ks_mode) > 1)) return;
+                this->stream_ks_mode            = this->serial_packet_data[2];
+                this->stream_keyframe_interval  = this->serial_packet_data[3];
+                this->output_write(return_arr, 4);
+                break;
+
+            case cmd_stream_interval:
+                this->stream_set_interval(this->serial_packet_data[2],
+                                          this->serial_packet_data[3] |
+                                          (this->serial_packet_data[4] << 8) |
+                                          (this->serial_packet_data[5] << 16) |
+                                          ((uint32_t)this->serial_packet_data[6] << 24));
+                this->output_write(return_arr, 4);
+                break;
+
+            case cmd_stream_stats:
+                if (this->serial_packet_data[2] >= MAX_STREAM) return;
+                stream = &(this->stream_control[this->serial_packet_data[2]]);
+                {
+                    uint8_t stats[8] = {
+                        (uint8_t)stream->samples, (uint8_t)(stream->samples >> 8), (uint8_t)(stream->samples >> 16), (uint8_t)(stream->samples >> 24),
+                        (uint8_t)stream->missed, (uint8_t)(stream->missed >> 8), (uint8_t)(stream->missed >> 16), (uint8_t)(stream->missed >> 24)
+                    };
+                    this->output_write(stats, 8);
+                }
+                break;
+
+            case cmd_scan_mode:
+                this->scan_mode = this->serial_packet_data[2];
+                this->output_write(return_arr, 4);
+                break;
+
+            case cmd_scan_delay_read:
+                if (!this->setup_complete || (this->scan_family() == scan_idle)) return;
+                this->output_write(this->scan_delay[this->scan_family()], SCAN_DELAY_PHASES);
+                break;
+
+            case cmd_scan_delay_write:
+                if (!this->setup_complete || (this->scan_family() == scan_idle)) return;
+                if (this->serial_packet_len < 2 + SCAN_DELAY_PHASES) return;
+                for (uint8_t i = 0; i < SCAN_DELAY_PHASES; i++)
+                {
+                    // Zero restores the default scan delay
+                    uint8_t delay = this->serial_packet_data[2 + i];
+                    this->scan_delay[this->scan_family()][i] = delay ? delay : SCAN_DELAY;
+                }
+                this->output_write(return_arr, 4);
+                break;
+
+            case cmd_scan_delay_calibrate:
+                if (!this->setup_complete) return;
+                if ((this->serial_packet_len > 2) && (this->serial_packet_data[2] > IQS9320_MAX_CHANNELS)) return;
+                if (!this->scan_calibrate((this->serial_packet_len > 2) ? this->serial_packet_data[2] : 0)) return;
+                this->output_write(this->scan_delay[this->scan_family()], SCAN_DELAY_PHASES);
+                break;
+
+            case cmd_config_status:
+                {
+                    // Status flags are cleared once read, the timeout count is not
+                    uint8_t status[3] = {
+                        this->config_status, (uint8_t)this->config_timeouts, (uint8_t)(this->config_timeouts >> 8)
+                    };
+                    this->config_status = config_ok;
+                    this->output_write(status, 3);
+                }
+                break;
+
+            case cmd_device_errors:
+                {
+                    // 0xFF selects the devices outside the device matrix
+                    device_errors_t *errors = this->i2c_device_errors(this->serial_packet_data[2]);
+                    uint8_t counts[8] = {
+                        (uint8_t)errors->nack, (uint8_t)(errors->nack >> 8),
+                        (uint8_t)errors->bus_timeout, (uint8_t)(errors->bus_timeout >> 8),
+                        (uint8_t)errors->config_timeout, (uint8_t)(errors->config_timeout >> 8),
+                        (uint8_t)this->i2c_recoveries, (uint8_t)(this->i2c_recoveries >> 8)
+                    };
+                    this->output_write(counts, 8);
+                }
+                break;
+
+            case cmd_register_cache_stats:
+                {
+                    register_cache_t *cache = &(this->register_cache);
+                    uint8_t stats[16] = {
+                        (uint8_t)cache->write_hits, (uint8_t)(cache->write_hits >> 8), (uint8_t)(cache->write_hits >> 16), (uint8_t)(cache->write_hits >> 24),
+                        (uint8_t)cache->write_misses, (uint8_t)(cache->write_misses >> 8), (uint8_t)(cache->write_misses >> 16), (uint8_t)(cache->write_misses >> 24),
+                        (uint8_t)cache->read_hits, (uint8_t)(cache->read_hits >> 8), (uint8_t)(cache->read_hits >> 16), (uint8_t)(cache->read_hits >> 24),
+                        (uint8_t)cache->read_misses, (uint8_t)(cache->read_misses >> 8), (uint8_t)(cache->read_misses >> 16), (uint8_t)(cache->read_misses >> 24)
+                    };
+                    this->output_write(stats, 16);
+                }
+                break;
+
+            case cmd_register_cache_invalidate:
+                this->cache_invalidate((this->serial_packet_len > 2) ? this->serial_packet_data[2] : 0xFF);
+                this->output_write(return_arr, 4);
+                break;
+
+            case cmd_register_cache_static:
+                if (this->serial_packet_len < 5) return;
+
+                // Zero length clears all static ranges
+                if (this->serial_packet_data[4] == 0)
+                {
+                    this->register_cache.num_static = 0;
+                }
+                else if (this->register_cache.num_static < REGISTER_CACHE_STATIC)
+                {
+                    this->register_cache.static_addr[this->register_cache.num_static] = this->serial_packet_data[2] | (this->serial_packet_data[3] << 8);
+                    this->register_cache.static_len[this->register_cache.num_static] = this->serial_packet_data[4];
+                    this->register_cache.num_static++;
+                }
+                else return;
+                this->output_write(return_arr, 4);
+                break;
+
+            case cmd_register_cache_skip:
+                if (this->serial_packet_len < 5) return;
+
+                // Zero length clears all skip ranges
+                if (this->serial_packet_data[4] == 0)
+                {
+                    this->register_cache.num_skip = 0;
+                }
+                else if (this->register_cache.num_skip < REGISTER_CACHE_SKIP)
+                {
+                    this->register_cache.skip_addr[this->register_cache.num_skip] = this->serial_packet_data[2] | (this->serial_packet_data[3] << 8);
+                    this->register_cache.skip_len[this->register_cache.num_skip] = this->serial_packet_data[4];
+                    this->register_cache.num_skip++;
+                }
+                else return;
+                this->output_write(return_arr, 4);
+                break;
+
             // ---------------------------------------------------------
             // IQS7220A
             // ---------------------------------------------------------
@@ -337,7 +564,7 @@ namespace AZO_KEYBOARD_INTERFACE
                 this->i2c_control.data_len          = this->serial_packet_data[5];
                 memcpy(this->i2c_control.output_data, &(this->serial_packet_data[6]), this->i2c_control.data_len);
                 this->iqs7220a_i2c_write_single();
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7220a_block_i2c_read_multi:
@@ -355,41 +582,50 @@ namespace AZO_KEYBOARD_INTERFACE
                 this->i2c_control.data_len          = this->serial_packet_data[4];
                 memcpy(this->i2c_control.output_data, &(this->serial_packet_data[5]), this->i2c_control.data_len);
                 this->iqs7220a_i2c_write_multi();
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
             
             case cmd_iqs7220a_stream_ks:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs7220a_ks;
-                Serial.write(return_arr, 4);
+                if ((this->stream_ks_mode == stream_ks_delta) && (this->stream_ks_others(cmd_iqs7220a_stream_ks) > 0)) return;
+                stream = this->stream_select(cmd_iqs7220a_stream_ks);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->state              = stream_iqs7220a_ks;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7220a_stream_i2c_read_single:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.device_select      = this->serial_packet_data[3];
-                this->i2c_control.device_addr           = this->serial_packet_data[4];
-                this->stream_control.num_registers      = this->serial_packet_data[5];
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[6]), this->stream_control.num_registers);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[6 + this->stream_control.num_registers]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs7220a_i2c;
-                Serial.write(return_arr, 4);
+                if (!this->stream_registers_valid(5, 1)) return;
+                stream = this->stream_select(cmd_iqs7220a_stream_i2c_read_single);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->device_select      = this->serial_packet_data[3];
+                stream->device_addr[0]     = this->serial_packet_data[4];
+                stream->num_registers      = this->serial_packet_data[5];
+                memcpy(stream->addr, &(this->serial_packet_data[6]), stream->num_registers);
+                memcpy(stream->len, &(this->serial_packet_data[6 + stream->num_registers]), stream->num_registers);
+                stream->state              = stream_iqs7220a_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7220a_stream_i2c_read_multi:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.device_select      = 0xFF;
-                this->i2c_control.device_addr           = this->serial_packet_data[3];
-                this->stream_control.num_registers      = this->serial_packet_data[4];
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[5]), this->stream_control.num_registers);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[5 + this->stream_control.num_registers]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs7220a_i2c;
-                Serial.write(return_arr, 4);
+                if (!this->stream_registers_valid(4, 1)) return;
+                stream = this->stream_select(cmd_iqs7220a_stream_i2c_read_multi);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->device_select      = 0xFF;
+                stream->device_addr[0]     = this->serial_packet_data[3];
+                stream->num_registers      = this->serial_packet_data[4];
+                memcpy(stream->addr, &(this->serial_packet_data[5]), stream->num_registers);
+                memcpy(stream->len, &(this->serial_packet_data[5 + stream->num_registers]), stream->num_registers);
+                stream->state              = stream_iqs7220a_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             // ---------------------------------------------------------
@@ -397,7 +633,7 @@ namespace AZO_KEYBOARD_INTERFACE
             // ---------------------------------------------------------
             case cmd_iqs7320a_block_ks:
                 if (!this->setup_complete) return;
-                this->iqs7220a_scan_keys_all();
+                this->iqs7320a_scan_keys_all();
                 break;
 
             case cmd_iqs7320a_block_i2c_read_single:
@@ -417,7 +653,7 @@ namespace AZO_KEYBOARD_INTERFACE
                 this->i2c_control.data_len          = this->serial_packet_data[5];
                 memcpy(this->i2c_control.output_data, &(this->serial_packet_data[6]), this->i2c_control.data_len);
                 this->iqs7220a_i2c_write_single();
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7320a_block_i2c_read_multi:
@@ -435,7 +671,7 @@ namespace AZO_KEYBOARD_INTERFACE
                 this->i2c_control.data_len          = this->serial_packet_data[4];
                 memcpy(this->i2c_control.output_data, &(this->serial_packet_data[5]), this->i2c_control.data_len);
                 this->iqs7220a_i2c_write_multi();
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7320a_block_autonomous:
@@ -448,7 +684,7 @@ namespace AZO_KEYBOARD_INTERFACE
                 {
                     iqs7320a_autonomous_enter();
                 }
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7320a_block_standby:
@@ -461,41 +697,50 @@ namespace AZO_KEYBOARD_INTERFACE
                 {
                     iqs7320a_standby_enter();
                 }
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
             
             case cmd_iqs7320a_stream_ks:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs7220a_ks;
-                Serial.write(return_arr, 4);
+                if ((this->stream_ks_mode == stream_ks_delta) && (this->stream_ks_others(cmd_iqs7320a_stream_ks) > 0)) return;
+                stream = this->stream_select(cmd_iqs7320a_stream_ks);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->state              = stream_iqs7320a_ks;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7320a_stream_i2c_read_single:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.device_select      = this->serial_packet_data[3];
-                this->i2c_control.device_addr           = this->serial_packet_data[4];
-                this->stream_control.num_registers      = this->serial_packet_data[5];
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[6]), this->stream_control.num_registers);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[6 + this->stream_control.num_registers]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs7220a_i2c;
-                Serial.write(return_arr, 4);
+                if (!this->stream_registers_valid(5, 1)) return;
+                stream = this->stream_select(cmd_iqs7320a_stream_i2c_read_single);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->device_select      = this->serial_packet_data[3];
+                stream->device_addr[0]     = this->serial_packet_data[4];
+                stream->num_registers      = this->serial_packet_data[5];
+                memcpy(stream->addr, &(this->serial_packet_data[6]), stream->num_registers);
+                memcpy(stream->len, &(this->serial_packet_data[6 + stream->num_registers]), stream->num_registers);
+                stream->state              = stream_iqs7320a_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs7320a_stream_i2c_read_multi:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->i2c_control.device_addr           = this->serial_packet_data[3];
-                this->stream_control.num_registers      = this->serial_packet_data[4];
-                this->stream_control.device_select      = 0xFF;
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[5]), this->stream_control.num_registers);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[5 + this->stream_control.num_registers]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs7220a_i2c;
-                Serial.write(return_arr, 4);
+                if (!this->stream_registers_valid(4, 1)) return;
+                stream = this->stream_select(cmd_iqs7320a_stream_i2c_read_multi);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->device_addr[0]     = this->serial_packet_data[3];
+                stream->num_registers      = this->serial_packet_data[4];
+                stream->device_select      = 0xFF;
+                memcpy(stream->addr, &(this->serial_packet_data[5]), stream->num_registers);
+                memcpy(stream->len, &(this->serial_packet_data[5 + stream->num_registers]), stream->num_registers);
+                stream->state              = stream_iqs7320a_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             // ---------------------------------------------------------
@@ -518,7 +763,7 @@ namespace AZO_KEYBOARD_INTERFACE
                 this->i2c_control.data_len          = this->serial_packet_data[5];
                 memcpy(this->i2c_control.output_data, &(this->serial_packet_data[6]), this->i2c_control.data_len);
                 this->iqs9320_i2c_write_fp();
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs9320_block_i2c_read_multi:
@@ -549,34 +794,41 @@ namespace AZO_KEYBOARD_INTERFACE
                         memcpy(this->i2c_control.output_data, &(this->serial_packet_data[6 + number_devices]), this->i2c_control.data_len);
                         this->iqs9320_i2c_write_fp();
                     }
-                    Serial.write(return_arr, 4);
+                    this->output_write(return_arr, 4);
                     break;
                 }
 
             case cmd_iqs9320_stream_i2c_read_single:
                 if (!this->setup_complete) return;
-                this->stream_control.num_devices        = 1;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.device_addr[0]     = this->serial_packet_data[3];
-                this->stream_control.num_registers      = this->serial_packet_data[4];
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[5]), this->stream_control.num_registers*2);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[5 + this->stream_control.num_registers*2]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs9320_i2c;
-                Serial.write(return_arr, 4);
+                if (!this->stream_registers_valid(4, 2)) return;
+                stream = this->stream_select(cmd_iqs9320_stream_i2c_read_single);
+                if (stream == nullptr) return;
+                stream->num_devices        = 1;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->device_addr[0]     = this->serial_packet_data[3];
+                stream->num_registers      = this->serial_packet_data[4];
+                memcpy(stream->addr, &(this->serial_packet_data[5]), stream->num_registers*2);
+                memcpy(stream->len, &(this->serial_packet_data[5 + stream->num_registers*2]), stream->num_registers);
+                stream->state              = stream_iqs9320_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs9320_stream_i2c_read_multi:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.num_devices        = this->serial_packet_data[3];
-                memcpy(this->stream_control.device_addr, &(this->serial_packet_data[4]), this->stream_control.num_devices);
-                this->stream_control.num_registers      = this->serial_packet_data[4 + this->stream_control.num_devices];
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[5 + this->stream_control.num_devices]), this->stream_control.num_registers*2);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[5 + this->stream_control.num_devices + this->stream_control.num_registers*2]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs9320_i2c;
-                Serial.write(return_arr, 4);
+                if ((this->serial_packet_len < 4) || (this->serial_packet_data[3] > sizeof(stream_control_t::device_addr))) return;
+                if (!this->stream_registers_valid(4 + this->serial_packet_data[3], 2)) return;
+                stream = this->stream_select(cmd_iqs9320_stream_i2c_read_multi);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->num_devices        = this->serial_packet_data[3];
+                memcpy(stream->device_addr, &(this->serial_packet_data[4]), stream->num_devices);
+                stream->num_registers      = this->serial_packet_data[4 + stream->num_devices];
+                memcpy(stream->addr, &(this->serial_packet_data[5 + stream->num_devices]), stream->num_registers*2);
+                memcpy(stream->len, &(this->serial_packet_data[5 + stream->num_devices + stream->num_registers*2]), stream->num_registers);
+                stream->state              = stream_iqs9320_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             // ---------------------------------------------------------
@@ -584,6 +836,7 @@ namespace AZO_KEYBOARD_INTERFACE
             // ---------------------------------------------------------
             case cmd_iqs9320_block_ks:
                 if (!this->setup_complete) return;
+                if (this->serial_packet_data[2] > IQS9320_MAX_CHANNELS) return;
                 this->iqs9320_scan_keys_all(this->serial_packet_data[2]);
                 break;
 
@@ -606,7 +859,7 @@ namespace AZO_KEYBOARD_INTERFACE
                 this->i2c_control.data_len          = this->serial_packet_data[6];
                 memcpy(this->i2c_control.output_data, &(this->serial_packet_data[7]), this->i2c_control.data_len);
                 this->iqs9320_i2c_write_ks();
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs9320_block_ks_i2c_read_multi:
@@ -615,10 +868,18 @@ namespace AZO_KEYBOARD_INTERFACE
                 this->i2c_control.register_addr_lsb = this->serial_packet_data[3];
                 this->i2c_control.register_addr_msb = this->serial_packet_data[4];
                 this->i2c_control.data_len          = this->serial_packet_data[5];
-                for (uint8_t i = 0; i < this->num_columns*this->num_rows; i++)
                 {
-                    this->i2c_control.device_select = i;
-                    this->iqs9320_i2c_read_ks();
+                    // No further device is addressed after one did not exit the configuration state
+                    bool released = true;
+
+                    for (uint8_t i = 0; i < this->num_columns*this->num_rows; i++)
+                    {
+                        this->i2c_control.device_select = i;
+                        if (released)
+                            released = this->iqs9320_i2c_read_ks();
+                        else
+                            this->output_zeros(this->i2c_control.data_len);
+                    }
                 }
                 break;
 
@@ -631,10 +892,11 @@ namespace AZO_KEYBOARD_INTERFACE
                 memcpy(this->i2c_control.output_data, &(this->serial_packet_data[6]), this->i2c_control.data_len);
                 for (uint8_t i = 0; i < this->num_columns*this->num_rows; i++)
                 {
+                    // No further device is addressed after one did not exit the configuration state
                     this->i2c_control.device_select = i;
-                    this->iqs9320_i2c_write_ks();
+                    if (!this->iqs9320_i2c_write_ks()) break;
                 }
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs9320_block_ks_standby:
@@ -647,42 +909,52 @@ namespace AZO_KEYBOARD_INTERFACE
                 {
                     this->iqs9320_standby_enter();
                 }
-                Serial.write(return_arr, 4);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs9320_stream_ks:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.timestamp          = millis();
-                this->stream_control.num_channels       = this->serial_packet_data[3];
-                this->stream_control.state              = stream_iqs9320_ks;
-                Serial.write(return_arr, 4);
+                if (this->serial_packet_data[3] > IQS9320_MAX_CHANNELS) return;
+                if ((this->stream_ks_mode == stream_ks_delta) && (this->stream_ks_others(cmd_iqs9320_stream_ks) > 0)) return;
+                stream = this->stream_select(cmd_iqs9320_stream_ks);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->num_channels       = this->serial_packet_data[3];
+                stream->state              = stream_iqs9320_ks;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs9320_stream_ks_i2c_read_single:
                 if (!this->setup_complete) return;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->stream_control.device_select      = this->serial_packet_data[3];
-                this->i2c_control.device_addr           = this->serial_packet_data[4];
-                this->stream_control.num_registers      = this->serial_packet_data[5];
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[6]), this->stream_control.num_registers*2);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[6 + this->stream_control.num_registers*2]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs9320_ks_i2c;
-                Serial.write(return_arr, 4);
+                if (!this->stream_registers_valid(5, 2)) return;
+                stream = this->stream_select(cmd_iqs9320_stream_ks_i2c_read_single);
+                if (stream == nullptr) return;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->device_select      = this->serial_packet_data[3];
+                stream->device_addr[0]     = this->serial_packet_data[4];
+                stream->num_registers      = this->serial_packet_data[5];
+                memcpy(stream->addr, &(this->serial_packet_data[6]), stream->num_registers*2);
+                memcpy(stream->len, &(this->serial_packet_data[6 + stream->num_registers*2]), stream->num_registers);
+                stream->state              = stream_iqs9320_ks_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
 
             case cmd_iqs9320_stream_ks_i2c_read_multi:
                 if (!this->setup_complete) return;
-                this->stream_control.device_select      = 0xFF;
-                this->stream_control.sample_interval    = this->serial_packet_data[2];
-                this->i2c_control.device_addr           = this->serial_packet_data[3];
-                this->stream_control.num_registers      = this->serial_packet_data[4];
-                memcpy(this->stream_control.addr, &(this->serial_packet_data[5]), this->stream_control.num_registers*2);
-                memcpy(this->stream_control.len, &(this->serial_packet_data[5 + this->stream_control.num_registers*2]), this->stream_control.num_registers);
-                this->stream_control.timestamp          = millis();
-                this->stream_control.state              = stream_iqs9320_ks_i2c;
-                Serial.write(return_arr, 4);
+                if (!this->stream_registers_valid(4, 2)) return;
+                stream = this->stream_select(cmd_iqs9320_stream_ks_i2c_read_multi);
+                if (stream == nullptr) return;
+                stream->device_select      = 0xFF;
+                stream->sample_interval    = this->serial_packet_data[2]*1000UL;
+                stream->device_addr[0]     = this->serial_packet_data[3];
+                stream->num_registers      = this->serial_packet_data[4];
+                memcpy(stream->addr, &(this->serial_packet_data[5]), stream->num_registers*2);
+                memcpy(stream->len, &(this->serial_packet_data[5 + stream->num_registers*2]), stream->num_registers);
+                stream->state              = stream_iqs9320_ks_i2c;
+                this->stream_start(stream);
+                this->output_write(return_arr, 4);
                 break;
         }
     }
@@ -0,0 +1,146 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_ring.hpp                                               *
+ * @brief       Wait-free single producer, single consumer byte ring. One     *
+ *              core (or thread) writes, the other reads, no locks are taken. *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+namespace AZO_KEYBOARD_INTERFACE
+{
+    /**
+    * @brief  Byte ring shared by exactly one producer and one consumer.
+    *         head is only written by the producer and tail only by the consumer.
+    *         Data is written before head is released, and read before tail is
+    *         released, so each side sees complete data without locks.
+    *         Indices run freely and wrap at 2^32, LEN must be a power of 2.
+    */
+    template <uint32_t LEN>
+    class SpscRing
+    {
+        static_assert((LEN & (LEN - 1)) == 0, "SpscRing length must be a power of 2");
+
+        public:
+            SpscRing() : head(0), tail(0) {}
+
+            /**
+            * @name   space
+            * @brief  Bytes the producer can write.
+            */
+            uint32_t space() const
+            {
+                return LEN - (this->head.load(std::memory_order_relaxed) - this->tail.load(std::memory_order_acquire));
+            }
+
+            /**
+            * @name   available
+            * @brief  Bytes the consumer can read.
+            */
+            uint32_t available() const
+            {
+                return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_relaxed);
+            }
+
+            /**
+            * @name   write
+            * @brief  Producer: write as many bytes as fit.
+            * @retval Returns the number of bytes written.
+            */
+            uint32_t write(const uint8_t data[], uint32_t len)
+            {
+                uint32_t head = this->head.load(std::memory_order_relaxed);
+                uint32_t free_len = LEN - (head - this->tail.load(std::memory_order_acquire));
+                uint32_t index = head & (LEN - 1);
+                uint32_t chunk;
+
+                if (len > free_len) len = free_len;
+
+                // At most two contiguous chunks
+                chunk = (len < LEN - index) ? len : LEN - index;
+                memcpy(&(this->buffer[index]), data, chunk);
+                memcpy(&(this->buffer[0]), data + chunk, len - chunk);
+
+                this->head.store(head + len, std::memory_order_release);
+                return len;
+            }
+
+            /**
+            * @name   push
+            * @brief  Producer: write all bytes or none, the consumer never sees part of them.
+            * @retval Returns false if the ring does not have space for all bytes.
+            */
+            bool push(const uint8_t data[], uint32_t len)
+            {
+                if (len > this->space()) return false;
+                this->write(data, len);
+                return true;
+            }
+
+            /**
+            * @name   peek
+            * @brief  Consumer: contiguous readable bytes, without releasing them.
+            * @param  data -> Receives a pointer to the first byte
+            * @retval Returns the number of contiguous bytes.
+            */
+            uint32_t peek(const uint8_t **data) const
+            {
+                uint32_t tail = this->tail.load(std::memory_order_relaxed);
+                uint32_t len = this->head.load(std::memory_order_acquire) - tail;
+                uint32_t index = tail & (LEN - 1);
+
+                *data = &(this->buffer[index]);
+                return (len < LEN - index) ? len : LEN - index;
+            }
+
+            /**
+            * @name   consume
+            * @brief  Consumer: release bytes returned by peek().
+            */
+            void consume(uint32_t len)
+            {
+                this->tail.store(this->tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+            }
+
+            /**
+            * @name   read
+            * @brief  Consumer: read and release up to len bytes.
+            * @retval Returns the number of bytes read.
+            */
+            uint32_t read(uint8_t data[], uint32_t len)
+            {
+                uint32_t count = 0;
+                const uint8_t *chunk_data;
+                uint32_t chunk;
+
+                while ((count < len) && ((chunk = this->peek(&chunk_data)) > 0))
+                {
+                    if (chunk > len - count) chunk = len - count;
+                    memcpy(data + count, chunk_data, chunk);
+                    this->consume(chunk);
+                    count += chunk;
+                }
+                return count;
+            }
+
+        private:
+            uint8_t                 buffer[LEN];
+            std::atomic<uint32_t>   head;       // Producer index
+            std::atomic<uint32_t>   tail;       // Consumer index
+    };
+}
\ No newline at end of file
@@ -0,0 +1,267 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_scan.cpp                                               *
+ * @brief       Resumable key scan of the device matrix. Every call of a      *
+ *              scan step drives one edge and returns, the next step reads    *
+ *              the result once the lines have settled. Serial is serviced    *
+ *              while waiting for the lines to settle. Also the configuration *
+ *              handshake waits.                                              *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include <assert.h>
+#include "azo_ki.hpp"
+
+namespace AZO_KEYBOARD_INTERFACE
+{
+    /**
+    * @name   scan_start
+    * @brief  Start a key scan of all columns in the device matrix. The first
+    *         step is due immediately.
+    * @param  state -> Device family to scan, scan_states_e
+    * @param  num_channels -> The number of channels the device is configured for (IQS9320 only),
+    *         at most IQS9320_MAX_CHANNELS.
+    * @retval None
+    */
+    void KeyboardInterface::scan_start(uint8_t state, uint8_t num_channels)
+    {
+        // Every channel fills a key scan bitplane, the commands reject larger counts
+        assert(num_channels <= IQS9320_MAX_CHANNELS);
+
+        this->scan_control.state = state;
+        this->scan_control.column = 0;
+        this->scan_control.phase = 0;
+        this->scan_control.cycle = 0;
+        this->scan_control.c0_state = 0;
+        this->scan_control.c0_release = 0;
+        this->scan_control.num_channels = num_channels;
+        this->scan_control.deadline = hal_time_us();
+    }
+
+    /**
+    * @name   scan_step
+    * @brief  Execute the next phase of the key scan in progress. Must only be
+    *         called once scan_control.deadline has passed.
+    * @param  None
+    * @retval Returns true when all columns have been scanned and the lines
+    *         have settled. The scan remains in progress until scan_output().
+    */
+    bool KeyboardInterface::scan_step()
+    {
+        switch (this->scan_control.state)
+        {
+            case scan_iqs7220a:
+                return this->iqs7220a_scan_step();
+
+            case scan_iqs7320a:
+                return this->iqs7320a_scan_step();
+
+            case scan_iqs9320:
+                return this->iqs9320_scan_step();
+        }
+        return true;
+    }
+
+    /**
+    * @name   scan_output
+    * @brief  Communicate the results of the completed key scan over serial
+    *         and end the scan.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::scan_output()
+    {
+        switch (this->scan_control.state)
+        {
+            case scan_iqs7220a:
+                // Send byte value for each device
+                this->key_scan_output(this->key_scan_planes, AZQ700_KS_OUTPUT_PARAMS, 1);
+                break;
+
+            case scan_iqs7320a:
+                // Send byte value for each device
+                this->key_scan_output(this->key_scan_planes, AZQ700_KS_OUTPUT_PARAMS, 1);
+                break;
+
+            case scan_iqs9320:
+                // Send 3 byte value for each device
+                this->key_scan_output(this->key_scan_planes, 2 + this->scan_control.num_channels, 3);
+                break;
+        }
+
+        this->scan_control.state = scan_idle;
+    }
+
+    /**
+    * @name   scan_cancel
+    * @brief  End the key scan in progress without sending its results. The remaining
+    *         edges are still driven, so that every device completes its key scan and
+    *         returns to idle. The open stream frame is dropped.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::scan_cancel()
+    {
+        if (this->scan_control.state == scan_idle) return;
+
+        this->settle_wait(this->scan_control.deadline);
+        while (!this->scan_step())
+        {
+            this->settle_wait(this->scan_control.deadline);
+        }
+
+        this->scan_control.state = scan_idle;
+        this->stream_frame_active = false;
+        this->stream_frame_skip = false;
+        this->stream_frame_len = 0;
+    }
+
+    /**
+    * @name   scan_family
+    * @brief  Key scan family of the device selected by the device setup.
+    * @param  None
+    * @retval Returns the scan_states_e family, or scan_idle if the device does not key scan.
+    */
+    uint8_t KeyboardInterface::scan_family()
+    {
+        switch (this->device)
+        {
+            case dev_iqs7220a:
+                return scan_iqs7220a;
+
+            case dev_iqs7320a:
+                return scan_iqs7320a;
+
+            case dev_iqs9320_ks:
+                return scan_iqs9320;
+        }
+        return scan_idle;
+    }
+
+    /**
+    * @name   scan_calibrate
+    * @brief  Measure the settle time of every scan phase of the device family.
+    *         Sequential scans are taken with the full SCAN_DELAY on every edge
+    *         while the row lines are watched, the last change after an edge marks
+    *         the settle time of its phase. Each phase delay is set to the longest
+    *         settle time seen plus SCAN_DELAY_MARGIN. Phases in which no row line
+    *         changed, or which need more than SCAN_DELAY, keep SCAN_DELAY.
+    * @param  num_channels -> The number of channels the device is configured for (IQS9320 only).
+    * @retval Returns false if the device does not key scan.
+    */
+    bool KeyboardInterface::scan_calibrate(uint8_t num_channels)
+    {
+        uint8_t family = this->scan_family();
+        uint8_t scan_mode = this->scan_mode;
+        uint8_t settle[SCAN_DELAY_PHASES] = {0};
+        bool changed[SCAN_DELAY_PHASES] = {false};
+        uint32_t rows_mask;
+
+        if (family == scan_idle) return false;
+
+        if (family == scan_iqs9320)
+        {
+            rows_mask = this->pin_settings.r0_all | this->pin_settings.r1_all | this->pin_settings.r2_all | this->pin_settings.r3_all;
+        }
+        else
+        {
+            rows_mask = this->pin_settings.d0_all | this->pin_settings.d1_all;
+        }
+
+        memset(this->scan_delay[family], SCAN_DELAY, SCAN_DELAY_PHASES);
+        this->scan_mode = scan_sequential;
+
+        for (uint8_t n = 0; n < SCAN_CALIBRATE_REPEATS; n++)
+        {
+            this->scan_start(family, num_channels);
+            while (!this->scan_step())
+            {
+                // Watch the row lines until the deadline
+                uint8_t k = this->scan_control.delay_index;
+                uint64_t edge = this->scan_control.deadline - SCAN_DELAY;
+                uint32_t previous = hal_gpio_input() & rows_mask;
+                uint64_t now;
+
+                while ((now = hal_time_us()) < this->scan_control.deadline)
+                {
+                    uint32_t input = hal_gpio_input() & rows_mask;
+                    if (input == previous) continue;
+
+                    // Round up, the change happened during the current microsecond
+                    previous = input;
+                    changed[k] = true;
+                    if (now - edge + 1 > settle[k]) settle[k] = now - edge + 1;
+                }
+            }
+            this->scan_control.state = scan_idle;
+        }
+
+        this->scan_mode = scan_mode;
+
+        for (uint8_t k = 0; k < SCAN_DELAY_PHASES; k++)
+        {
+            if (changed[k] && (settle[k] + SCAN_DELAY_MARGIN < SCAN_DELAY))
+            {
+                this->scan_delay[family][k] = settle[k] + SCAN_DELAY_MARGIN;
+            }
+        }
+        return true;
+    }
+
+    /**
+    * @name   settle_wait
+    * @brief  Wait for the matrix lines to settle. The serial port keeps sending
+    *         the previous response and receiving into the ring buffer meanwhile.
+    * @param  deadline -> hal_time_us() at which the wait ends
+    * @retval None
+    */
+    void KeyboardInterface::settle_wait(uint64_t deadline)
+    {
+        while (hal_time_us() < deadline)
+        {
+            this->serial_service();
+        }
+    }
+
+    /**
+    * @name   config_await
+    * @brief  Wait for a device to acknowledge a configuration handshake edge.
+    *         The line is polled without delay, so the wait ends as soon as the
+    *         device responds. On timeout the status flag is raised for the
+    *         status command and in the stream frame in progress, and the timeout
+    *         is counted against i2c_device.
+    * @param  mask -> Line on which the device acknowledges
+    * @param  level -> Level which acknowledges, true for HIGH
+    * @param  status -> config_status_e flag to raise on timeout
+    * @retval Returns false if the line did not reach the level within CONFIG_ACK_TIMEOUT.
+    */
+    bool KeyboardInterface::config_await(uint32_t mask, bool level, uint8_t status)
+    {
+        uint64_t timeout = hal_time_us() + CONFIG_ACK_TIMEOUT;
+
+        while (((hal_gpio_input() & mask) != 0) != level)
+        {
+            if (hal_time_us() >= timeout)
+            {
+                device_errors_t *errors = this->i2c_device_errors(this->i2c_device);
+
+                if (errors->config_timeout < 0xFFFF) errors->config_timeout++;
+                this->config_status |= status;
+                this->stream_frame_status |= status;
+                if (this->config_timeouts < 0xFFFF) this->config_timeouts++;
+                return false;
+            }
+        }
+        return true;
+    }
+}
\ No newline at end of file
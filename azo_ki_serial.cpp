@@ -19,148 +19,595 @@
 
 namespace AZO_KEYBOARD_INTERFACE
 {
-    uint8_t     serial_data_byte;
-    bool        header_a_received, header_b_received;
-
     /**
     * @name   read_serial
-    * @brief  Verify that serial data is available and place the serial data
-    *         in byte arrays after parsing packet headers.
+    * @brief  Move all bytes waiting in the serial buffer to the receive ring buffer.
+    *         The first SERIAL_FRAME_MAX bytes of the ring are mirrored after its end,
+    *         so that any packet in the ring can be accessed as a contiguous array.
     * @param  None
-    * @retval Returns a boolean value to indicate if serial data is available 
-    *         in the serial buffer.
+    * @retval Returns a boolean value to indicate if serial data was received.
     */
     bool KeyboardInterface::read_serial()
     {
-        if (Serial.available())
+        uint16_t available = Serial.available();
+        bool received = false;
+
+        // Bulk read into the ring buffer, in at most two contiguous chunks
+        while (available > 0)
         {
-            serial_data_byte = (uint8_t)Serial.read();
+            uint16_t free_len = SERIAL_RX_LEN - (uint16_t)(this->serial_rx_head - this->serial_rx_tail);
+            uint16_t head = this->serial_rx_head & (SERIAL_RX_LEN - 1);
+            uint16_t chunk = SERIAL_RX_LEN - head;
 
-            if (header_a_received)
-            {
-                // Start receiving package if header bytes have been received
-                if (header_b_received)
-                {
-                    this->serial_comms_state = true;
-                    this->serial_input_data[this->serial_input_index] = serial_data_byte;
-                    this->serial_input_index++;
-                }
-                // Await header byte B
-                else if ((uint8_t)serial_data_byte == (uint8_t)SERIAL_HEADER_B)
-                {
-                    header_b_received = true;
-                }
-                // Reset if second byte is not header byte B
-                else
-                {
-                    header_a_received = false;
-                    header_b_received = false;
-                }   
-            }
-            // Await header byte A
-            else if ((uint8_t)serial_data_byte == (uint8_t)SERIAL_HEADER_A)
+            if (chunk > free_len) chunk = free_len;
+            if (chunk > available) chunk = available;
+            if (chunk == 0) break;
+
+            chunk = Serial.readBytes(&(this->serial_rx_ring[head]), chunk);
+            if (chunk == 0) break;
+
+            // Mirror the start of the ring
+            if (head < SERIAL_FRAME_MAX)
             {
-                header_a_received = true;
+                memcpy(&(this->serial_rx_ring[SERIAL_RX_LEN + head]), &(this->serial_rx_ring[head]),
+                       (chunk < SERIAL_FRAME_MAX - head) ? chunk : SERIAL_FRAME_MAX - head);
             }
-            return true;
+
+            this->serial_rx_head += chunk;
+            available -= chunk;
+            received = true;
         }
-        return false;
+
+        if (received) this->serial_rx_timestamp = millis();
+        return received;
     }
     
     /**
     * @name   get_crc
     * @brief  Returns the CRC16 value for a given array of byte values.
+    *         The engine is selected at compile time with CRC_ENGINE. The DMA
+    *         sniffer is a single resource, in AZO_KI_DUAL_CORE builds only the
+    *         engine core uses it and the serial core uses the table engine.
     * @param  data -> Random byte array
     * @param  data_len -> Length of data parameter
     * @retval Returns a uint16_t containing calculated CRC16 value.
     */
     uint16_t KeyboardInterface::get_crc(uint8_t data[], uint8_t data_len)
     {
-        uint16_t crc = 0xFFFF;
-        uint8_t j;
-
-        for (uint8_t i = 0; i < data_len; i++)
-        {
-            crc = crc ^ (((uint16_t)data[i]) << 8);
-            j = 0;
-            while (j++ < 8)
-            {
-                if (crc & 0x8000)
-                    crc = crc << 1 ^ 0x1021;
-                else
-                    crc = crc << 1;
-            }
-        }
-
-        return crc;
+#if CRC_ENGINE == CRC_ENGINE_BITWISE
+        return crc16_bitwise(data, data_len);
+#elif CRC_ENGINE == CRC_ENGINE_SLICE4
+        return crc16_slice4(data, data_len);
+#elif CRC_ENGINE == CRC_ENGINE_DMA
+#if defined(AZO_KI_DUAL_CORE) && !defined(AZO_KI_HOST)
+        if (get_core_num() == 0) return crc16_table(data, data_len);
+#endif
+        return crc16_dma(data, data_len);
+#else
+        return crc16_table(data, data_len);
+#endif
     }
 
     /**
     * @name   test_for_packet
-    * @brief  Test if a valid packet has been received after verifying that
-    *         no serial data is available. The device will send a serial response
+    * @brief  Parse the receive ring buffer in place for the next valid packet.
+    *         On a bad length, CRC or end of frame, or when a partial packet stops
+    *         receiving bytes, parsing restarts at the byte after the rejected header.
+    *         A valid packet is left in the ring and serial_rx_packet points to it
+    *         until the next call. The device will send a serial response
     *         if a valid serial packet has been received.
     * @param  None
     * @retval Returns a boolean to indicate whether a valid packet has been received.
     */
     bool KeyboardInterface::test_for_packet()
-    {   
-        // Verify that data has been received
-        if (this->serial_packet_len > 0)
+    {
+        // Release the packet returned by the previous call
+        this->serial_rx_tail += this->serial_rx_consumed;
+        this->serial_rx_consumed = 0;
+
+        while (true)
         {
-            // Parse data if number if bytes received is greater that expected (excluding end of package)
-            if (this->serial_input_index > (this->serial_packet_len + 3))
+            uint16_t available = this->serial_rx_head - this->serial_rx_tail;
+            uint8_t *frame = &(this->serial_rx_ring[this->serial_rx_tail & (SERIAL_RX_LEN - 1)]);
+
+            switch (this->serial_rx_state)
             {
-                // Verify that package is complete
-                if( this->serial_input_data[this->serial_packet_len+4] == (uint8_t)SERIAL_HEADER_B && 
-                    this->serial_input_data[this->serial_packet_len+3] == (uint8_t)SERIAL_HEADER_A
-                )
-                {
-                    uint16_t crc_result = this->serial_input_data[this->serial_packet_len+1] + 
-                                            (this->serial_input_data[this->serial_packet_len+2] << 8);
-
-                    if (this->get_crc(&(this->serial_input_data[1]), this->serial_packet_len) == crc_result)
+                case rx_await_header_a:
                     {
-                        // Copy in to packet array
-                        memcpy(this->serial_packet_data, &(this->serial_input_data[1]), this->serial_packet_len);
+                        if (available == 0) return false;
 
-                        // Clear serial input array
-                        this->serial_input_index = 0;
-                        this->serial_packet_len = 0;
-                        header_a_received = false;
-                        header_b_received = false;
+                        // Skip to the next header byte A in the contiguous part of the ring
+                        uint16_t contiguous = SERIAL_RX_LEN - (this->serial_rx_tail & (SERIAL_RX_LEN - 1));
+                        if (contiguous > available) contiguous = available;
+                        uint8_t *header = (uint8_t*)memchr(frame, SERIAL_HEADER_A, contiguous);
 
-                        // Send response back to PC
-                        this->send_packet_response();
+                        if (header == nullptr)
+                        {
+                            this->serial_rx_tail += contiguous;
+                        }
+                        else
+                        {
+                            this->serial_rx_tail += header - frame;
+                            this->serial_rx_state = rx_await_header_b;
+                        }
+                        break;
+                    }
+
+                case rx_await_header_b:
+                    if (available < 2) return false;
+                    if (frame[1] == SERIAL_HEADER_B)
+                    {
+                        this->serial_rx_state = rx_await_length;
+                    }
+                    else
+                    {
+                        this->serial_rx_tail++;
+                        this->serial_rx_state = rx_await_header_a;
+                    }
+                    break;
+
+                case rx_await_length:
+                    if (available < 3) return false;
+                    this->serial_rx_packet_len = frame[2];
+
+                    // Frame ID and command are always present
+                    if ((this->serial_rx_packet_len < 2) || (this->serial_rx_packet_len > PACKET_LEN))
+                    {
+                        this->serial_rx_tail++;
+                        this->serial_rx_state = rx_await_header_a;
+                    }
+                    else
+                    {
+                        this->serial_rx_state = rx_await_frame;
+                    }
+                    break;
+
+                case rx_await_frame:
+                    {
+                        uint8_t len = this->serial_rx_packet_len;
+
+                        if (available < len + 7)
+                        {
+                            // Drop a partial packet that stopped receiving bytes
+                            if (millis() - this->serial_rx_timestamp < SERIAL_RX_TIMEOUT) return false;
+                            this->serial_rx_tail++;
+                            this->serial_rx_state = rx_await_header_a;
+                            break;
+                        }
+
+                        uint16_t crc_result = frame[len+3] + (frame[len+4] << 8);
+
+                        // Verify that package is complete and valid
+                        if ((frame[len+5] != SERIAL_HEADER_A) || (frame[len+6] != SERIAL_HEADER_B) ||
+                            (this->get_crc(&(frame[3]), len) != crc_result))
+                        {
+                            this->serial_rx_tail++;
+                            this->serial_rx_state = rx_await_header_a;
+                            break;
+                        }
+
+                        // Hand out the packet in place, release it on the next call
+                        this->serial_rx_packet = &(frame[3]);
+                        this->serial_rx_consumed = len + 7;
+                        this->serial_rx_state = rx_await_header_a;
+
+#if !defined(AZO_KI_DUAL_CORE)
+                        // Send response back to PC, the engine core sends it when it takes the packet
+                        this->send_packet_response(this->serial_rx_packet);
+#endif
 
                         return true;
                     }
-                }
+
+                default:
+                    this->serial_rx_state = rx_await_header_a;
+                    break;
             }
         }
-        // Receive expected number of bytes
-        else if (this->serial_input_index > 0)
-        {
-            this->serial_packet_len = this->serial_input_data[0];
-        }
-        return false;
     }
 
     /**
     * @name   send_packet_response
     * @brief  Sends a response over serial to indicate that a valid packet has been received.
-    * @param  None
+    * @param  packet -> Packet data, frame ID and command first
     * @retval None
     */
-    void KeyboardInterface::send_packet_response()
+    void KeyboardInterface::send_packet_response(const uint8_t packet[])
     {
         this->serial_output_data[0] = SERIAL_HEADER_A;
         this->serial_output_data[1] = SERIAL_HEADER_B;
-        this->serial_output_data[2] = serial_packet_data[0];
-        this->serial_output_data[3] = serial_packet_data[1];
+        this->serial_output_data[2] = packet[0];
+        this->serial_output_data[3] = packet[1];
         this->serial_output_data[4] = SERIAL_HEADER_A;
         this->serial_output_data[5] = SERIAL_HEADER_B;
 
-        Serial.write(this->serial_output_data, 6);
+        this->output_append(this->serial_output_data, 6);
+    }
+
+    /**
+    * @name   write_serial
+    * @brief  Continue sending the previous response. Only as many bytes as
+    *         the serial port can accept without blocking are written.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::write_serial()
+    {
+        uint8_t sending = this->serial_tx_active ^ 1;
+        uint16_t remaining = this->serial_tx_len[sending] - this->serial_tx_index;
+
+        if (remaining == 0) return;
+
+        int space = Serial.availableForWrite();
+        if (space <= 0) return;
+        if (remaining > space) remaining = space;
+
+        Serial.write(&(this->serial_tx_buffer[sending][this->serial_tx_index]), remaining);
+        this->serial_tx_index += remaining;
+    }
+
+    /**
+    * @name   serial_tx_append
+    * @brief  Add response bytes to the TX buffer being filled.
+    *         A full buffer is handed over to be sent and filling continues in the other buffer.
+    * @param  data -> Byte array
+    * @param  data_len -> Length of data parameter
+    * @retval None
+    */
+    void KeyboardInterface::serial_tx_append(const uint8_t data[], uint16_t data_len)
+    {
+        while (data_len > 0)
+        {
+            uint8_t active = this->serial_tx_active;
+            uint16_t chunk = SERIAL_TX_LEN - this->serial_tx_len[active];
+
+            if (chunk == 0)
+            {
+                this->serial_tx_swap();
+                continue;
+            }
+            if (chunk > data_len) chunk = data_len;
+
+            memcpy(&(this->serial_tx_buffer[active][this->serial_tx_len[active]]), data, chunk);
+            this->serial_tx_len[active] += chunk;
+            data += chunk;
+            data_len -= chunk;
+        }
+    }
+
+    /**
+    * @name   serial_tx_swap
+    * @brief  Hand the filled TX buffer over to be sent and start filling the other buffer.
+    *         Waits for the previous buffer to be sent completely first.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::serial_tx_swap()
+    {
+        uint8_t sending = this->serial_tx_active ^ 1;
+
+        if (this->serial_tx_len[this->serial_tx_active] == 0) return;
+
+        // Blocking write of what remains of the previous buffer
+        if (this->serial_tx_index < this->serial_tx_len[sending])
+        {
+            Serial.write(&(this->serial_tx_buffer[sending][this->serial_tx_index]),
+                         this->serial_tx_len[sending] - this->serial_tx_index);
+        }
+
+        this->serial_tx_len[sending] = 0;
+        this->serial_tx_index = 0;
+        this->serial_tx_active = sending;
+
+        this->write_serial();
+    }
+
+    /**
+    * @name   output_append
+    * @brief  Add complete response bytes to the serial output. In single core builds
+    *         they go straight to the TX buffer. In AZO_KI_DUAL_CORE builds the engine
+    *         core writes them to output_ring, waiting while the ring is full, and the
+    *         serial core moves them to the TX buffer.
+    * @param  data -> Byte array
+    * @param  data_len -> Length of data parameter
+    * @retval None
+    */
+    void KeyboardInterface::output_append(const uint8_t data[], uint16_t data_len)
+    {
+#if defined(AZO_KI_DUAL_CORE)
+        while (data_len > 0)
+        {
+            uint16_t written = this->output_ring.write(data, data_len);
+            data += written;
+            data_len -= written;
+        }
+#else
+        this->serial_tx_append(data, data_len);
+#endif
+    }
+
+    /**
+    * @name   output_flush
+    * @brief  The response or stream sample is complete, hand it over to be sent.
+    *         In AZO_KI_DUAL_CORE builds the serial core sends the ring contents as
+    *         soon as the previous TX buffer has been sent, nothing is left to do.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::output_flush()
+    {
+#if !defined(AZO_KI_DUAL_CORE)
+        this->serial_tx_swap();
+#endif
+    }
+
+    /**
+    * @name   serial_tx_drain
+    * @brief  Serial core: move response bytes from output_ring to the TX buffer being
+    *         filled, as far as it has space. The buffer is handed over to be sent once
+    *         the previous one has been sent completely, so the serial core never blocks.
+    *         Only used in AZO_KI_DUAL_CORE builds.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::serial_tx_drain()
+    {
+#if defined(AZO_KI_DUAL_CORE)
+        const uint8_t *data;
+        uint32_t len;
+
+        while ((len = this->output_ring.peek(&data)) > 0)
+        {
+            uint8_t active = this->serial_tx_active;
+            uint16_t space = SERIAL_TX_LEN - this->serial_tx_len[active];
+
+            if (space == 0) break;
+            if (len > space) len = space;
+
+            this->serial_tx_append(data, len);
+            this->output_ring.consume(len);
+        }
+
+        // Previous buffer sent, start sending the one being filled
+        if (this->serial_tx_index == this->serial_tx_len[this->serial_tx_active ^ 1]) this->serial_tx_swap();
+#endif
+    }
+
+    /**
+    * @name   serial_service
+    * @brief  Keep the serial port sending and receiving while the engine waits on
+    *         the matrix lines or the I2C bus. In AZO_KI_DUAL_CORE builds the serial
+    *         core owns the port and the engine core does not touch it.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::serial_service()
+    {
+#if !defined(AZO_KI_DUAL_CORE)
+        this->write_serial();
+        this->read_serial();
+#endif
+    }
+
+    /**
+    * @name   output_write
+    * @brief  Send a single response byte. See output_write(data, data_len).
+    * @param  data -> Byte value
+    * @retval None
+    */
+    void KeyboardInterface::output_write(uint8_t data)
+    {
+        this->output_write(&data, 1);
+    }
+
+    /**
+    * @name   output_write
+    * @brief  Send response data. Block command responses are added to the
+    *         TX buffer as is. While a stream sample is being built the data is added to the
+    *         stream frame, which is sent as a fragment whenever it is full.
+    * @param  data -> Byte array
+    * @param  data_len -> Length of data parameter
+    * @retval None
+    */
+    void KeyboardInterface::output_write(const uint8_t data[], uint16_t data_len)
+    {
+        if (!this->stream_frame_active)
+        {
+            this->output_append(data, data_len);
+            return;
+        }
+
+        while (data_len > 0)
+        {
+            uint8_t chunk = STREAM_DATA_LEN - this->stream_frame_len;
+
+            if (chunk == 0)
+            {
+                this->stream_frame_send(false);
+                continue;
+            }
+            if (chunk > data_len) chunk = data_len;
+
+            memcpy(&(this->stream_frame[3 + STREAM_HEADER_LEN + this->stream_frame_len]), data, chunk);
+            this->stream_frame_len += chunk;
+            data += chunk;
+            data_len -= chunk;
+        }
+    }
+
+    /**
+    * @name   output_zeros
+    * @brief  Send zeros in place of the data of a device that could not be addressed.
+    * @param  data_len -> Number of zero bytes
+    * @retval None
+    */
+    void KeyboardInterface::output_zeros(uint16_t data_len)
+    {
+        static const uint8_t zeros[16] = {0};
+
+        while (data_len > 0)
+        {
+            uint8_t chunk = (data_len < sizeof(zeros)) ? data_len : sizeof(zeros);
+
+            this->output_write(zeros, chunk);
+            data_len -= chunk;
+        }
+    }
+
+    /**
+    * @name   stream_frame_begin
+    * @brief  Start a new stream sample. All output until stream_frame_end()
+    *         is sent in frames sharing the same sequence number and timestamp.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::stream_frame_begin()
+    {
+        this->stream_frame_active = true;
+        this->stream_frame_len = 0;
+        this->stream_frame_fragment = 0;
+        this->stream_frame_status = config_ok;
+        this->stream_frame_timestamp = micros();
+    }
+
+    /**
+    * @name   stream_frame_send
+    * @brief  Complete the stream frame header, CRC16 and EOF and send the frame.
+    *         Frame data: stream ID (slot), command, sequence number (LSB first),
+    *         timestamp in microseconds (LSB first), fragment index (bit 7 set
+    *         on the last fragment of a sample), status (config_status_e flags
+    *         raised by the sample so far) and the sample data.
+    * @param  last -> Last fragment of the sample
+    * @retval None
+    */
+    void KeyboardInterface::stream_frame_send(bool last)
+    {
+        uint8_t *frame = this->stream_frame;
+        uint8_t len = STREAM_HEADER_LEN + this->stream_frame_len;
+        uint16_t crc_result;
+
+        frame[0]  = SERIAL_HEADER_A;
+        frame[1]  = SERIAL_HEADER_B;
+        frame[2]  = len;
+        frame[3]  = this->stream_slot;
+        frame[4]  = this->stream_control[this->stream_slot].command;
+        frame[5]  = this->stream_control[this->stream_slot].sequence & 0xFF;
+        frame[6]  = this->stream_control[this->stream_slot].sequence >> 8;
+        frame[7]  = this->stream_frame_timestamp & 0xFF;
+        frame[8]  = (this->stream_frame_timestamp >> 8) & 0xFF;
+        frame[9]  = (this->stream_frame_timestamp >> 16) & 0xFF;
+        frame[10] = (this->stream_frame_timestamp >> 24) & 0xFF;
+        frame[11] = this->stream_frame_fragment | (last ? STREAM_FRAGMENT_LAST : 0);
+        frame[12] = this->stream_frame_status;
+
+        crc_result = this->get_crc(&(frame[3]), len);
+        frame[len+3] = crc_result & 0xFF;
+        frame[len+4] = crc_result >> 8;
+        frame[len+5] = SERIAL_HEADER_A;
+        frame[len+6] = SERIAL_HEADER_B;
+
+        this->output_append(frame, len + 7);
+
+        this->stream_frame_len = 0;
+        this->stream_frame_fragment++;
+    }
+
+    /**
+    * @name   stream_frame_end
+    * @brief  Send the last fragment of the current stream sample.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::stream_frame_end()
+    {
+        this->stream_frame_active = false;
+
+        // Samples without any data to report are not sent at all
+        if (this->stream_frame_skip && (this->stream_frame_fragment == 0))
+        {
+            this->stream_frame_skip = false;
+            return;
+        }
+
+        this->stream_frame_send(true);
+        this->stream_control[this->stream_slot].sequence++;
+    }
+
+    /**
+    * @name   key_scan_output
+    * @brief  Output the key scan results of all devices, num_bytes per device (LSB first)
+    *         with bit n holding the state of channel plane n. Block commands and full mode
+    *         streams return every device. Delta mode streams start with the sample type,
+    *         a keyframe returns every device and a delta only returns the index and result
+    *         of the devices that changed since the previous sample.
+    * @param  planes -> Key scan bitplanes, one bit per device
+    * @param  num_planes -> Number of bitplanes
+    * @param  num_bytes -> Bytes per device result
+    * @retval None
+    */
+    void KeyboardInterface::key_scan_output(const uint64_t planes[], uint8_t num_planes, uint8_t num_bytes)
+    {
+        uint8_t num_devices = this->num_columns*this->num_rows;
+        uint64_t devices = (num_devices < 64) ? (((uint64_t)1 << num_devices) - 1) : ~(uint64_t)0;
+        bool delta = false;
+        uint8_t data[4];
+
+        if (this->stream_frame_active && (this->stream_ks_mode == stream_ks_delta))
+        {
+            stream_control_t *stream = &(this->stream_control[this->stream_slot]);
+
+            // First sample of a stream and every keyframe interval samples (0 = first only) is a keyframe
+            if ((stream->sequence == 0) ||
+                ((this->stream_keyframe_interval != 0) && (stream->keyframe_count >= this->stream_keyframe_interval)))
+            {
+                stream->keyframe_count = 0;
+                this->output_write(ks_sample_keyframe);
+            }
+            else
+            {
+                delta = true;
+                this->output_write(ks_sample_delta);
+            }
+            if (stream->keyframe_count < 0xFF) stream->keyframe_count++;
+        }
+
+        if (delta)
+        {
+            // Devices with any channel changed since the previous sample
+            uint64_t changed = 0;
+            for (uint8_t k = 0; k < num_planes; k++)
+            {
+                changed |= planes[k] ^ this->key_scan_previous[k];
+            }
+            devices &= changed;
+
+            // A delta without changes is not sent
+            if (devices == 0) this->stream_frame_skip = true;
+        }
+
+        while (devices)
+        {
+            uint8_t device_index = __builtin_ctzll(devices);
+            uint32_t device_result = 0;
+            devices &= devices - 1;
+
+            for (uint8_t k = 0; k < num_planes; k++)
+            {
+                device_result |= (uint32_t)((planes[k] >> device_index) & 1) << k;
+            }
+
+            data[0] = device_index;
+            data[1] = device_result & 0xFF;
+            data[2] = (device_result >> 8) & 0xFF;
+            data[3] = (device_result >> 16) & 0xFF;
+
+            if (delta)
+                this->output_write(data, 1 + num_bytes);
+            else
+                this->output_write(&(data[1]), num_bytes);
+        }
+
+        // Block command results are not part of the stream
+        if (this->stream_frame_active) memcpy(this->key_scan_previous, planes, num_planes*sizeof(uint64_t));
     }
 }
\ No newline at end of file
@@ -0,0 +1,523 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_stream.cpp                                             *
+ * @brief       Stream slots and the deadline ordered stream scheduler.       *
+ *              Active slots are kept in a min-heap on their next sample      *
+ *              deadline, the earliest due stream is sampled first.           *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include "azo_ki.hpp"
+
+namespace AZO_KEYBOARD_INTERFACE
+{
+    /**
+    * @name   stream_select
+    * @brief  Select the slot for a new stream. A stream started with the same
+    *         command as an active stream replaces it, otherwise the first free
+    *         slot is used.
+    * @param  command -> Stream command
+    * @retval Returns the stream slot, or nullptr if all MAX_STREAM slots are in use.
+    */
+    stream_control_t* KeyboardInterface::stream_select(uint8_t command)
+    {
+        uint8_t free_slot = MAX_STREAM;
+
+        for (uint8_t i = 0; i < MAX_STREAM; i++)
+        {
+            if (this->stream_control[i].state == stream_disabled)
+            {
+                if (free_slot == MAX_STREAM) free_slot = i;
+            }
+            else if (this->stream_control[i].command == command)
+            {
+                this->stream_stop(i);
+                free_slot = i;
+                break;
+            }
+        }
+
+        if (free_slot == MAX_STREAM) return nullptr;
+
+        this->stream_control[free_slot].command = command;
+        return &(this->stream_control[free_slot]);
+    }
+
+    /**
+    * @name   stream_start
+    * @brief  Schedule the first sample of a configured stream one interval from now.
+    * @param  stream -> Stream slot returned by stream_select
+    * @retval None
+    */
+    void KeyboardInterface::stream_start(stream_control_t *stream)
+    {
+        stream->deadline = hal_time_us() + stream->sample_interval;
+        stream->sequence = 0;
+        stream->keyframe_count = 0;
+        stream->samples = 0;
+        stream->missed = 0;
+
+        switch (stream->state)
+        {
+            case stream_iqs7220a_i2c:
+            case stream_iqs7320a_i2c:
+                this->stream_plan_bursts(stream, 1, IQS7X20A_REGISTER_BYTES);
+                break;
+
+            case stream_iqs9320_ks_i2c:
+                this->stream_plan_bursts(stream, 2, IQS9320_REGISTER_BYTES);
+                break;
+
+            default:
+                stream->num_bursts = 0;
+                break;
+        }
+
+        this->stream_heap_push(stream - this->stream_control);
+    }
+
+    /**
+    * @name   stream_stop
+    * @brief  Stop the stream in a slot. A key scan of the stream in progress is
+    *         cancelled, its sample is not sent.
+    * @param  slot -> Stream slot
+    * @retval None
+    */
+    void KeyboardInterface::stream_stop(uint8_t slot)
+    {
+        if ((slot >= MAX_STREAM) || (this->stream_control[slot].state == stream_disabled)) return;
+
+        if (this->stream_frame_active && (this->stream_slot == slot)) this->scan_cancel();
+
+        for (uint8_t i = 0; i < this->stream_heap_len; i++)
+        {
+            if (this->stream_heap[i] == slot)
+            {
+                this->stream_heap_remove(i);
+                break;
+            }
+        }
+        this->stream_control[slot].state = stream_disabled;
+    }
+
+    /**
+    * @name   stream_stop_all
+    * @brief  Stop all streams. A stream key scan in progress is cancelled.
+    * @param  None
+    * @retval None
+    */
+    void KeyboardInterface::stream_stop_all()
+    {
+        if (this->stream_frame_active) this->scan_cancel();
+
+        for (uint8_t i = 0; i < MAX_STREAM; i++)
+        {
+            this->stream_control[i].state = stream_disabled;
+        }
+        this->stream_heap_len = 0;
+    }
+
+    /**
+    * @name   stream_ks_others
+    * @brief  Count the active key scan streams other than the one of a command.
+    *         Delta mode compares every sample against the single key_scan_previous,
+    *         so only one key scan stream can run while delta mode is selected.
+    * @param  command -> Stream command, its own stream is replaced and not counted
+    * @retval Returns the number of other active key scan streams.
+    */
+    uint8_t KeyboardInterface::stream_ks_others(uint8_t command)
+    {
+        uint8_t count = 0;
+
+        for (uint8_t i = 0; i < MAX_STREAM; i++)
+        {
+            uint8_t state = this->stream_control[i].state;
+
+            if (((state == stream_iqs7220a_ks) || (state == stream_iqs7320a_ks) || (state == stream_iqs9320_ks)) &&
+                (this->stream_control[i].command != command))
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    /**
+    * @name   stream_set_interval
+    * @brief  Change the sample interval of an active stream.
+    *         The next sample is scheduled one new interval from now.
+    * @param  slot -> Stream slot
+    * @param  sample_interval -> Sample interval in microseconds
+    * @retval None
+    */
+    void KeyboardInterface::stream_set_interval(uint8_t slot, uint32_t sample_interval)
+    {
+        if ((slot >= MAX_STREAM) || (this->stream_control[slot].state == stream_disabled)) return;
+
+        for (uint8_t i = 0; i < this->stream_heap_len; i++)
+        {
+            if (this->stream_heap[i] == slot)
+            {
+                this->stream_heap_remove(i);
+                break;
+            }
+        }
+
+        this->stream_control[slot].sample_interval = sample_interval;
+        this->stream_control[slot].deadline = hal_time_us() + sample_interval;
+        this->stream_heap_push(slot);
+    }
+
+    /**
+    * @name   stream_schedule
+    * @brief  Sample the stream with the earliest deadline if it is due and schedule
+    *         its next sample one interval after the previous deadline. Deadlines
+    *         that passed while sampling are skipped and counted as missed.
+    * @param  None
+    * @retval Returns true if a stream has been sampled.
+    */
+    bool KeyboardInterface::stream_schedule()
+    {
+        if (this->stream_heap_len == 0) return false;
+
+        uint8_t slot = this->stream_heap[0];
+        stream_control_t *stream = &(this->stream_control[slot]);
+        uint64_t now = hal_time_us();
+
+        if (now < stream->deadline) return false;
+
+        this->stream_heap_remove(0);
+        this->stream_sample(slot);
+        stream->samples++;
+
+        now = hal_time_us();
+        stream->deadline += stream->sample_interval;
+        if ((stream->deadline < now) && (stream->sample_interval > 0))
+        {
+            uint32_t missed = (now - stream->deadline)/stream->sample_interval + 1;
+            stream->missed += missed;
+            stream->deadline += (uint64_t)missed*stream->sample_interval;
+        }
+        this->stream_heap_push(slot);
+
+        return true;
+    }
+
+    /**
+    * @name   stream_heap_push
+    * @brief  Insert a slot into the deadline heap.
+    * @param  slot -> Stream slot
+    * @retval None
+    */
+    void KeyboardInterface::stream_heap_push(uint8_t slot)
+    {
+        uint8_t i = this->stream_heap_len++;
+
+        // Sift up
+        while (i > 0)
+        {
+            uint8_t parent = (i - 1)/2;
+            if (!(this->stream_control[slot].deadline < this->stream_control[this->stream_heap[parent]].deadline)) break;
+            this->stream_heap[i] = this->stream_heap[parent];
+            i = parent;
+        }
+        this->stream_heap[i] = slot;
+    }
+
+    /**
+    * @name   stream_heap_remove
+    * @brief  Remove an entry from the deadline heap.
+    * @param  index -> Heap index
+    * @retval None
+    */
+    void KeyboardInterface::stream_heap_remove(uint8_t index)
+    {
+        uint8_t slot = this->stream_heap[--this->stream_heap_len];
+        uint8_t i = index;
+
+        if (index == this->stream_heap_len) return;
+
+        // Move the last entry into the gap, sift up
+        while (i > 0)
+        {
+            uint8_t parent = (i - 1)/2;
+            if (!(this->stream_control[slot].deadline < this->stream_control[this->stream_heap[parent]].deadline)) break;
+            this->stream_heap[i] = this->stream_heap[parent];
+            i = parent;
+        }
+
+        // Sift down
+        while (true)
+        {
+            uint8_t child = 2*i + 1;
+            if (child >= this->stream_heap_len) break;
+            if ((child + 1 < this->stream_heap_len) &&
+                (this->stream_control[this->stream_heap[child + 1]].deadline < this->stream_control[this->stream_heap[child]].deadline)) child++;
+            if (!(this->stream_control[this->stream_heap[child]].deadline < this->stream_control[slot].deadline)) break;
+            this->stream_heap[i] = this->stream_heap[child];
+            i = child;
+        }
+        this->stream_heap[i] = slot;
+    }
+
+    /**
+    * @name   stream_sample
+    * @brief  Take one sample of a stream and send it as one or more stream frames.
+    *         Key scan streams only start the scan, do_comms() steps it while the
+    *         lines settle and sends the sample once it has completed.
+    * @param  slot -> Stream slot
+    * @retval None
+    */
+    void KeyboardInterface::stream_sample(uint8_t slot)
+    {
+        stream_control_t *stream = &(this->stream_control[slot]);
+
+        this->stream_slot = slot;
+        this->stream_frame_begin();
+
+        switch (stream->state)
+        {
+            case stream_iqs7220a_ks:
+                // Stepped from do_comms(), the frame is ended once the scan completed
+                this->scan_start(scan_iqs7220a, 0);
+                return;
+
+            case stream_iqs7220a_i2c:
+                // All registers of a device are read in one configuration session,
+                // from all devices in the matrix (0xFF) or the selected device only
+                this->i2c_control.device_addr = stream->device_addr[0];
+                this->i2c_control.device_select = stream->device_select;
+                this->iqs7220a_i2c_read_batch(stream);
+                break;
+
+            case stream_iqs7320a_ks:
+                // Stepped from do_comms(), the frame is ended once the scan completed
+                this->scan_start(scan_iqs7320a, 0);
+                return;
+
+            case stream_iqs7320a_i2c:
+                // All registers of a device are read in one configuration session,
+                // from all devices in the matrix (0xFF) or the selected device only
+                this->i2c_control.device_addr = stream->device_addr[0];
+                this->i2c_control.device_select = stream->device_select;
+                this->iqs7320a_i2c_read_batch(stream);
+                break;
+
+            case stream_iqs9320_i2c:
+                for (uint8_t i = 0; i < stream->num_registers; i++)
+                {
+                    for (uint8_t j = 0; j < stream->num_devices; j++)
+                    {
+                        this->i2c_control.device_addr = stream->device_addr[j];
+                        this->i2c_control.register_addr_lsb = stream->addr[(2*i)];
+                        this->i2c_control.register_addr_msb = stream->addr[(2*i)+1];
+                        this->i2c_control.data_len = stream->len[i];
+                        this->iqs9320_i2c_read_fp();
+                    }
+                }
+                break;
+
+            case stream_iqs9320_ks:
+                // Stepped from do_comms(), the frame is ended once the scan completed
+                this->scan_start(scan_iqs9320, stream->num_channels);
+                return;
+
+            case stream_iqs9320_ks_i2c:
+                // All registers of a device are read in one configuration session,
+                // from all devices in the matrix (0xFF) or the selected device only
+                this->i2c_control.device_addr = stream->device_addr[0];
+                this->i2c_control.device_select = stream->device_select;
+                this->iqs9320_i2c_read_ks_batch(stream);
+                break;
+        }
+
+        this->stream_frame_end();
+    }
+
+    /**
+    * @name   stream_plan_bursts
+    * @brief  Merge the registers of an I2C stream into auto-increment burst reads.
+    *         Registers are taken in address order, a register that starts at most
+    *         STREAM_BURST_GAP bytes after the end of the current burst (or overlaps
+    *         it) extends the burst. The bursts of a device must fit in input_data,
+    *         otherwise every register is read on its own.
+    * @param  stream -> Stream with the registers to read
+    * @param  addr_bytes -> Bytes per register address in addr (LSB first)
+    * @param  register_bytes -> Bytes per register address of the device memory map
+    * @retval None
+    */
+    void KeyboardInterface::stream_plan_bursts(stream_control_t *stream, uint8_t addr_bytes, uint8_t register_bytes)
+    {
+        uint8_t order[20];
+        uint32_t start[20];
+        uint32_t burst_start = 0, burst_end = 0;
+        uint16_t data_len = 0;
+        uint8_t num_bursts = 0;
+
+        stream->num_bursts = 0;
+        if ((stream->num_registers == 0) || (stream->num_registers*addr_bytes > 20)) return;
+
+        // Start byte of every register, insertion sort by start
+        for (uint8_t i = 0; i < stream->num_registers; i++)
+        {
+            uint8_t j = i;
+
+            start[i] = stream->addr[addr_bytes*i];
+            if (addr_bytes == 2) start[i] |= (uint32_t)stream->addr[(addr_bytes*i)+1] << 8;
+            start[i] *= register_bytes;
+
+            while ((j > 0) && (start[order[j-1]] > start[i]))
+            {
+                order[j] = order[j-1];
+                j--;
+            }
+            order[j] = i;
+        }
+
+        for (uint8_t i = 0; i < stream->num_registers; i++)
+        {
+            uint8_t k = order[i];
+            uint32_t end = start[k] + stream->len[k];
+
+            if ((num_bursts == 0) || (start[k] > burst_end + STREAM_BURST_GAP))
+            {
+                // New burst, the register address of the previous one is final
+                if (num_bursts > 0) data_len += burst_end - burst_start;
+                burst_start = start[k];
+                burst_end = end;
+                num_bursts++;
+            }
+            else if (end > burst_end)
+            {
+                burst_end = end;
+            }
+
+            if ((burst_end - burst_start > 255) || (data_len + burst_end - burst_start > PACKET_LEN)) return;
+
+            stream->burst_addr[addr_bytes*(num_bursts-1)] = (burst_start/register_bytes) & 0xFF;
+            if (addr_bytes == 2) stream->burst_addr[(addr_bytes*(num_bursts-1))+1] = (burst_start/register_bytes) >> 8;
+            stream->burst_len[num_bursts-1] = burst_end - burst_start;
+            stream->offset[k] = data_len + (start[k] - burst_start);
+        }
+
+        // Bursts only pay off when they replace reads
+        if (num_bursts < stream->num_registers) stream->num_bursts = num_bursts;
+    }
+
+    /**
+    * @name   stream_registers_valid
+    * @brief  Check the register list of an I2C stream setup packet before it is copied
+    *         into the stream. The register addresses must fit in stream_control_t.addr,
+    *         and every register in input_data. A rejected setup is not acknowledged.
+    * @param  index -> Index of the number of registers in serial_packet_data, followed
+    *                  by the register addresses and the register lengths
+    * @param  addr_bytes -> Bytes per register address (LSB first)
+    * @retval Returns false if the stream must not be set up.
+    */
+    bool KeyboardInterface::stream_registers_valid(uint8_t index, uint8_t addr_bytes)
+    {
+        uint8_t num_registers;
+        const uint8_t *len;
+
+        if (index >= this->serial_packet_len) return false;
+        num_registers = this->serial_packet_data[index];
+        if (num_registers*addr_bytes > sizeof(stream_control_t::addr)) return false;
+        if (index + 1 + num_registers*(addr_bytes + 1) > this->serial_packet_len) return false;
+
+        len = &(this->serial_packet_data[index + 1 + num_registers*addr_bytes]);
+        for (uint8_t k = 0; k < num_registers; k++)
+        {
+            if (len[k] > PACKET_LEN) return false;
+        }
+        return true;
+    }
+
+    /**
+    * @name   stream_read_registers
+    * @brief  Read the registers of an I2C stream from the device in the configuration
+    *         state and output them in the requested order. When the data fits in
+    *         input_data all reads are queued at once and serial is serviced while they
+    *         are in flight: planned bursts are read and the registers taken from the
+    *         burst data, otherwise every register is read to its own offset. Larger
+    *         streams read the registers one by one.
+    * @param  stream -> Stream with the registers to read
+    * @param  addr_bytes -> Bytes per register address in addr (LSB first)
+    * @retval None
+    */
+    void KeyboardInterface::stream_read_registers(const stream_control_t *stream, uint8_t addr_bytes)
+    {
+        uint16_t data_len = 0;
+
+        if (stream->num_bursts == 0)
+        {
+            for (uint8_t k = 0; k < stream->num_registers; k++) data_len += stream->len[k];
+
+            // Too large for input_data, one register at a time
+            if (data_len > PACKET_LEN)
+            {
+                for (uint8_t k = 0; k < stream->num_registers; k++)
+                {
+                    this->i2c_submit(&(stream->addr[addr_bytes*k]), addr_bytes, this->i2c_control.input_data, stream->len[k]);
+                    this->i2c_wait();
+                    this->output_write(this->i2c_control.input_data, stream->len[k]);
+                    memset(this->i2c_control.input_data, 0, stream->len[k]);
+                }
+                return;
+            }
+
+            // Registers in the requested order, each at its own offset
+            data_len = 0;
+            for (uint8_t k = 0; k < stream->num_registers; k++)
+            {
+                this->i2c_submit(&(stream->addr[addr_bytes*k]), addr_bytes,
+                                 &(this->i2c_control.input_data[data_len]), stream->len[k]);
+                data_len += stream->len[k];
+            }
+            this->i2c_wait();
+
+            this->output_write(this->i2c_control.input_data, data_len);
+            memset(this->i2c_control.input_data, 0, data_len);
+            return;
+        }
+
+        for (uint8_t b = 0; b < stream->num_bursts; b++)
+        {
+            this->i2c_submit(&(stream->burst_addr[addr_bytes*b]), addr_bytes,
+                             &(this->i2c_control.input_data[data_len]), stream->burst_len[b]);
+            data_len += stream->burst_len[b];
+        }
+        this->i2c_wait();
+
+        // Scatter into the requested layout
+        for (uint8_t k = 0; k < stream->num_registers; k++)
+        {
+            this->output_write(&(this->i2c_control.input_data[stream->offset[k]]), stream->len[k]);
+        }
+        memset(this->i2c_control.input_data, 0, data_len);
+    }
+
+    /**
+    * @name   stream_skip_registers
+    * @brief  Output zeros in place of the registers of an I2C stream, for a device
+    *         that could not be placed in the configuration state.
+    * @param  stream -> Stream with the registers that are skipped
+    * @retval None
+    */
+    void KeyboardInterface::stream_skip_registers(const stream_control_t *stream)
+    {
+        for (uint8_t k = 0; k < stream->num_registers; k++)
+        {
+            this->output_zeros(stream->len[k]);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        Arduino.h                                                     *
+ * @brief       Minimal Arduino core replacement for the host (Linux) build.  *
+ *              Provides the virtual clock backed timing functions and an     *
+ *              in-memory Serial port.                                        *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <vector>
+
+// Timing - advances or reads the virtual clock
+unsigned long   millis();
+unsigned long   micros();
+void            delay(unsigned long ms);
+void            delayMicroseconds(unsigned int us);
+
+class HostSerial
+{
+    public:
+        // Arduino API
+        void    begin(unsigned long baud);
+        int     available();
+        int     availableForWrite();
+        int     read();
+        size_t  readBytes(uint8_t *buffer, size_t length);
+        size_t  write(uint8_t data);
+        size_t  write(const uint8_t *buffer, size_t size);
+        void    flush();
+        operator bool() { return true; }
+
+        // Host side of the port
+        void                    inject(const uint8_t *data, size_t length);
+        std::vector<uint8_t>    take_output();
+        uint32_t                write_calls;
+        uint32_t                bytes_written;
+
+    private:
+        std::deque<uint8_t>     rx;
+        std::vector<uint8_t>    tx;
+};
+
+extern HostSerial Serial;
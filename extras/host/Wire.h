@@ -0,0 +1,57 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        Wire.h                                                        *
+ * @brief       Wire (I2C) replacement for the host (Linux) build.            *
+ *              Transactions are routed to the simulated I2C bus and the      *
+ *              bus time is added to the virtual clock.                       *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#pragma once
+
+#include "Arduino.h"
+
+#define WIRE_BUFFER_LEN     256
+
+class TwoWire
+{
+    public:
+        void    setSDA(uint8_t pin);
+        void    setSCL(uint8_t pin);
+        void    begin();
+        void    end();
+        void    setClock(uint32_t frequency);
+        void    setTimeout(uint32_t timeout_ms = 25, bool reset_with_timeout = false);
+
+        void    beginTransmission(uint8_t address);
+        size_t  write(uint8_t data);
+        size_t  write(const uint8_t *data, size_t length);
+        uint8_t endTransmission(bool stop_bit = true);
+        size_t  requestFrom(uint8_t address, size_t quantity, bool stop_bit = true);
+        int     available();
+        int     read();
+
+        uint32_t clock;
+        uint32_t timeout_ms;
+        uint32_t sda_msk;
+
+    private:
+        uint8_t tx_address;
+        uint8_t tx_data[WIRE_BUFFER_LEN];
+        size_t  tx_len;
+        uint8_t rx_data[WIRE_BUFFER_LEN];
+        size_t  rx_len;
+        size_t  rx_index;
+};
+
+extern TwoWire Wire;
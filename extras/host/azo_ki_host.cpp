@@ -0,0 +1,442 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_host.cpp                                               *
+ * @brief       Host (Linux) backend of the hardware abstraction layer,       *
+ *              Arduino timing functions, Serial and Wire replacements.       *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include "azo_ki_host.hpp"
+#include "azo_ki_hal.hpp"
+#include "Wire.h"
+
+HostSerial  Serial;
+TwoWire     Wire;
+
+namespace AZO_HOST
+{
+    uint64_t                        clock_ns;
+    uint32_t                        mcu_output_enable;
+    uint32_t                        mcu_output;
+    uint32_t                        pull_ups;
+    std::vector<HostPeripheral*>    peripherals;
+
+    uint64_t time_ns()
+    {
+        return clock_ns;
+    }
+
+    void advance_ns(uint64_t ns)
+    {
+        clock_ns += ns;
+    }
+
+    void reset()
+    {
+        clock_ns = 0;
+        mcu_output_enable = 0;
+        mcu_output = 0;
+        pull_ups = 0;
+        peripherals.clear();
+    }
+
+    void attach(HostPeripheral *peripheral)
+    {
+        peripherals.push_back(peripheral);
+    }
+
+    void detach_all()
+    {
+        peripherals.clear();
+    }
+
+    uint32_t gpio_mcu_low()
+    {
+        return mcu_output_enable & ~mcu_output;
+    }
+
+    uint32_t gpio_pull_ups()
+    {
+        return pull_ups;
+    }
+
+    /**
+    * @name   gpio_notify
+    * @brief  Inform all peripherals that the MCU changed the line drive state.
+    */
+    static void gpio_notify()
+    {
+        uint32_t mcu_low = gpio_mcu_low();
+        for (HostPeripheral *peripheral : peripherals)
+        {
+            peripheral->gpio_changed(mcu_low, clock_ns);
+        }
+    }
+
+    HostPeripheral *i2c_select(uint8_t address)
+    {
+        for (HostPeripheral *peripheral : peripherals)
+        {
+            if (peripheral->i2c_acknowledge(address)) return peripheral;
+        }
+        return nullptr;
+    }
+
+    /**
+    * @name   i2c_bus_ns
+    * @brief  Bus time of an I2C transfer.
+    *         Every byte (including the address byte) takes 9 clock cycles,
+    *         start/restart and stop conditions take one cycle each.
+    */
+    static uint64_t i2c_bus_ns(size_t bytes)
+    {
+        uint32_t clock = Wire.clock ? Wire.clock : 100000;
+        return ((1 + bytes) * 9 + 2) * 1000000000ULL / clock;
+    }
+
+    static void i2c_bus_time(size_t bytes)
+    {
+        advance_ns(i2c_bus_ns(bytes));
+    }
+
+    /**
+    * @name   i2c_bus_held
+    * @brief  True while a peripheral pulls SDA LOW, no transfer can complete.
+    */
+    static bool i2c_bus_held()
+    {
+        for (HostPeripheral *peripheral : peripherals)
+        {
+            if (peripheral->gpio_pull_low(clock_ns) & Wire.sda_msk) return true;
+        }
+        return false;
+    }
+
+    // Non-blocking register read in progress
+    static uint64_t i2c_async_done_ns;
+    static bool     i2c_async_nack;
+}
+
+using namespace AZO_HOST;
+
+// -----------------------------------------------------------------------------
+// Hardware abstraction layer
+// -----------------------------------------------------------------------------
+uint32_t hal_gpio_input()
+{
+    uint32_t low = gpio_mcu_low();
+
+    for (HostPeripheral *peripheral : peripherals)
+    {
+        low |= peripheral->gpio_pull_low(clock_ns);
+    }
+    advance_ns(HOST_GPIO_ACCESS_NS);
+
+    // Undriven lines without pull-up float, treat them as HIGH
+    return ~low & HOST_GPIO_ALL;
+}
+
+void hal_gpio_output_clear(uint32_t mask)
+{
+    mcu_output &= ~mask;
+    advance_ns(HOST_GPIO_ACCESS_NS);
+    gpio_notify();
+}
+
+void hal_gpio_output_enable_set(uint32_t mask)
+{
+    mcu_output_enable |= mask;
+    advance_ns(HOST_GPIO_ACCESS_NS);
+    gpio_notify();
+}
+
+void hal_gpio_output_enable_clear(uint32_t mask)
+{
+    mcu_output_enable &= ~mask;
+    advance_ns(HOST_GPIO_ACCESS_NS);
+    gpio_notify();
+}
+
+void hal_gpio_pad_setup(uint8_t pin)
+{
+    pull_ups |= 1UL << pin;
+}
+
+uint64_t hal_time_us()
+{
+    // Reading the timer costs time, so that polling loops make progress
+    advance_ns(HOST_GPIO_ACCESS_NS);
+    return clock_ns/1000;
+}
+
+/**
+* @name   hal_i2c_read_start
+* @brief  Start a non-blocking register read. The data is transferred at once,
+*         the read completes once the virtual clock has passed its bus time.
+*/
+bool hal_i2c_read_start(uint8_t address, const uint8_t reg[], uint8_t reg_len, uint8_t data[], uint8_t len)
+{
+    HostPeripheral *peripheral = i2c_select(address);
+
+    // A held bus never completes the transfer
+    if (i2c_bus_held())
+    {
+        i2c_async_nack = false;
+        i2c_async_done_ns = UINT64_MAX;
+        return true;
+    }
+
+    if (peripheral == nullptr)
+    {
+        i2c_async_nack = true;
+        i2c_async_done_ns = clock_ns + i2c_bus_ns(0);
+        return true;
+    }
+
+    peripheral->i2c_write(reg, reg_len);
+    peripheral->i2c_read(data, len);
+    peripheral->i2c_stop();
+    i2c_async_nack = false;
+    i2c_async_done_ns = clock_ns + i2c_bus_ns(reg_len) + i2c_bus_ns(len);
+    return true;
+}
+
+uint8_t hal_i2c_status()
+{
+    // Reading the status costs time, so that polling loops make progress
+    advance_ns(HOST_GPIO_ACCESS_NS);
+    if (clock_ns < i2c_async_done_ns) return hal_i2c_busy;
+    return i2c_async_nack ? hal_i2c_nack : hal_i2c_done;
+}
+
+void hal_i2c_abort()
+{
+    i2c_async_nack = false;
+    i2c_async_done_ns = 0;
+}
+
+// -----------------------------------------------------------------------------
+// Arduino timing
+// -----------------------------------------------------------------------------
+unsigned long millis()
+{
+    return (unsigned long)(clock_ns/1000000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)(clock_ns/1000);
+}
+
+void delay(unsigned long ms)
+{
+    advance_ns((uint64_t)ms*1000000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    advance_ns((uint64_t)us*1000);
+}
+
+// -----------------------------------------------------------------------------
+// Serial
+// -----------------------------------------------------------------------------
+void HostSerial::begin(unsigned long baud)
+{
+    (void)baud;
+    this->rx.clear();
+    this->tx.clear();
+    this->write_calls = 0;
+    this->bytes_written = 0;
+}
+
+int HostSerial::available()
+{
+    return (int)this->rx.size();
+}
+
+int HostSerial::availableForWrite()
+{
+    return 256;
+}
+
+int HostSerial::read()
+{
+    if (this->rx.empty()) return -1;
+    uint8_t data = this->rx.front();
+    this->rx.pop_front();
+    return data;
+}
+
+size_t HostSerial::readBytes(uint8_t *buffer, size_t length)
+{
+    size_t count = 0;
+    while ((count < length) && !this->rx.empty())
+    {
+        buffer[count++] = this->rx.front();
+        this->rx.pop_front();
+    }
+    return count;
+}
+
+size_t HostSerial::write(uint8_t data)
+{
+    return this->write(&data, 1);
+}
+
+size_t HostSerial::write(const uint8_t *buffer, size_t size)
+{
+    this->tx.insert(this->tx.end(), buffer, buffer + size);
+    this->write_calls++;
+    this->bytes_written += size;
+    return size;
+}
+
+void HostSerial::flush()
+{
+}
+
+void HostSerial::inject(const uint8_t *data, size_t length)
+{
+    this->rx.insert(this->rx.end(), data, data + length);
+}
+
+std::vector<uint8_t> HostSerial::take_output()
+{
+    std::vector<uint8_t> output;
+    output.swap(this->tx);
+    return output;
+}
+
+// -----------------------------------------------------------------------------
+// Wire
+// -----------------------------------------------------------------------------
+void TwoWire::setSDA(uint8_t pin)
+{
+    this->sda_msk = 1UL << pin;
+}
+
+void TwoWire::setSCL(uint8_t pin)
+{
+    (void)pin;
+}
+
+void TwoWire::begin()
+{
+    this->tx_len = 0;
+    this->rx_len = 0;
+    this->rx_index = 0;
+}
+
+void TwoWire::end()
+{
+}
+
+void TwoWire::setClock(uint32_t frequency)
+{
+    this->clock = frequency;
+}
+
+void TwoWire::setTimeout(uint32_t timeout_ms, bool reset_with_timeout)
+{
+    (void)reset_with_timeout;
+    this->timeout_ms = timeout_ms;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    this->tx_address = address;
+    this->tx_len = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if (this->tx_len >= WIRE_BUFFER_LEN) return 0;
+    this->tx_data[this->tx_len++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t length)
+{
+    size_t count = 0;
+    while ((count < length) && this->write(data[count])) count++;
+    return count;
+}
+
+uint8_t TwoWire::endTransmission(bool stop_bit)
+{
+    bool acknowledged = false;
+
+    // SDA held LOW, the transfer times out
+    if (i2c_bus_held())
+    {
+        advance_ns((uint64_t)this->timeout_ms*1000000);
+        return 5;
+    }
+
+    // Every peripheral that acknowledges the address receives the data
+    for (HostPeripheral *peripheral : peripherals)
+    {
+        if (!peripheral->i2c_acknowledge(this->tx_address)) continue;
+        peripheral->i2c_write(this->tx_data, this->tx_len);
+        if (stop_bit) peripheral->i2c_stop();
+        acknowledged = true;
+    }
+
+    // Address NACK ends the transfer after the address byte
+    if (!acknowledged)
+    {
+        i2c_bus_time(0);
+        return 2;
+    }
+
+    i2c_bus_time(this->tx_len);
+    return 0;
+}
+
+size_t TwoWire::requestFrom(uint8_t address, size_t quantity, bool stop_bit)
+{
+    HostPeripheral *peripheral = i2c_select(address);
+
+    this->rx_len = 0;
+    this->rx_index = 0;
+    if (quantity > WIRE_BUFFER_LEN) quantity = WIRE_BUFFER_LEN;
+
+    if (i2c_bus_held())
+    {
+        advance_ns((uint64_t)this->timeout_ms*1000000);
+        return 0;
+    }
+
+    if (peripheral == nullptr)
+    {
+        i2c_bus_time(0);
+        return 0;
+    }
+
+    this->rx_len = peripheral->i2c_read(this->rx_data, quantity);
+    if (stop_bit) peripheral->i2c_stop();
+    i2c_bus_time(this->rx_len);
+    return this->rx_len;
+}
+
+int TwoWire::available()
+{
+    return (int)(this->rx_len - this->rx_index);
+}
+
+int TwoWire::read()
+{
+    if (this->rx_index >= this->rx_len) return -1;
+    return this->rx_data[this->rx_index++];
+}
@@ -0,0 +1,70 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_host.hpp                                               *
+ * @brief       Host (Linux) backend of the hardware abstraction layer.       *
+ *              Virtual clock, simulated GPIO bank and simulated I2C bus.     *
+ *              Simulated devices attach to the GPIO bank and I2C bus by      *
+ *              implementing the HostPeripheral interface.                    *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#pragma once
+
+#include "Arduino.h"
+
+// Virtual cost of a single SIO register access (one cycle at 133 MHz)
+#define HOST_GPIO_ACCESS_NS     8
+// Virtual cost of a single loop() iteration without any other work
+#define HOST_LOOP_NS            500
+// All 30 RP2040 GPIO pins
+#define HOST_GPIO_ALL           0x3FFFFFFF
+
+namespace AZO_HOST
+{
+    /**
+    * @brief  Interface for simulated devices connected to the GPIO bank
+    *         and the I2C bus. All lines are open-drain with pull-ups, a line
+    *         is LOW when the MCU or any peripheral pulls it LOW.
+    */
+    class HostPeripheral
+    {
+        public:
+            virtual ~HostPeripheral() {}
+
+            // GPIO - mcu_low contains every line the MCU currently pulls LOW
+            virtual void        gpio_changed(uint32_t mcu_low, uint64_t now_ns) { (void)mcu_low; (void)now_ns; }
+            virtual uint32_t    gpio_pull_low(uint64_t now_ns) { (void)now_ns; return 0; }
+
+            // I2C - only a peripheral that acknowledges the address sees the data
+            virtual bool        i2c_acknowledge(uint8_t address) { (void)address; return false; }
+            virtual void        i2c_write(const uint8_t *data, size_t length) { (void)data; (void)length; }
+            virtual size_t      i2c_read(uint8_t *data, size_t length) { (void)data; return length; }
+            virtual void        i2c_stop() {}
+    };
+
+    // Virtual clock
+    uint64_t    time_ns();
+    void        advance_ns(uint64_t ns);
+    void        reset();
+
+    // Peripherals
+    void        attach(HostPeripheral *peripheral);
+    void        detach_all();
+
+    // Simulated GPIO bank
+    uint32_t    gpio_mcu_low();
+    uint32_t    gpio_pull_ups();
+
+    // Simulated I2C bus
+    HostPeripheral *i2c_select(uint8_t address);
+}
@@ -0,0 +1,1064 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_host_bench.cpp                                         *
+ * @brief       Scan and I2C timing benchmark against the simulated device    *
+ *              matrix. Commands are sent over the simulated serial port,     *
+ *              the virtual time until the response is complete is reported   *
+ *              and the response data is verified against the models.        *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+#include <string>
+#include "azo_ki.hpp"
+#include "azo_ki_host_bench.hpp"
+
+using namespace AZO_KEYBOARD_INTERFACE;
+
+extern KeyboardInterface kb_obj;
+
+namespace AZO_HOST
+{
+    std::vector<SimDevice*>     bench_devices;
+    uint32_t                    bench_failures;
+    uint32_t                    bench_write_calls;
+    const pin_settings_t        *bench_pins = &default_pin_settings;
+
+    // Host only pinout of the full 30 GPIO, wires 7 x 7 IQS7x20A and 8 x 5 IQS9320 devices
+    constexpr pin_settings_t wide_pin_settings = pin_settings_make({
+        .serial_baud_rate   = 115200,
+        .i2c_clk            = 1000000,
+        .pin_sda_0          = 4,
+        .pin_scl_0          = 5,
+        .c0_msk             = {1 << 0,  1 << 1,  1 << 2,  1 << 3,  1 << 6,  1 << 7,  1 << 8,  1 << 9},
+        .r0_msk             = {1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14},
+        .r1_msk             = {1 << 15, 1 << 16, 1 << 17, 1 << 18, 1 << 19},
+        .r2_msk             = {1 << 20, 1 << 21, 1 << 22, 1 << 23, 1 << 24},
+        .r3_msk             = {1 << 25, 1 << 26, 1 << 27, 1 << 28, 1 << 29},
+        .s0_msk             = {1 << 0,  1 << 1,  1 << 2,  1 << 3,  1 << 6,  1 << 7,  1 << 8},
+        .s1_msk             = {1 << 9,  1 << 10, 1 << 11, 1 << 12, 1 << 13, 1 << 14, 1 << 15},
+        .d0_msk             = {1 << 16, 1 << 17, 1 << 18, 1 << 19, 1 << 20, 1 << 21, 1 << 22},
+        .d1_msk             = {1 << 23, 1 << 24, 1 << 25, 1 << 26, 1 << 27, 1 << 28, 1 << 29}
+    });
+
+    static_assert((wide_pin_settings.iqs7x20a_columns == 7) && (wide_pin_settings.iqs7x20a_rows == 7) &&
+                  (wide_pin_settings.iqs9320_columns == 8) && (wide_pin_settings.iqs9320_rows == 5),
+                  "The wide pinout must wire 7 x 7 IQS7x20A and 8 x 5 IQS9320 devices");
+
+    /**
+    * @name   bench_select_pinout
+    * @brief  Rebuild the sketch interface with the wide pinout, before setup().
+    *         The device models are wired to the same pinout.
+    */
+    void bench_select_pinout(bool wide)
+    {
+        if (!wide) return;
+
+        bench_pins = &wide_pin_settings;
+        kb_obj.~KeyboardInterface();
+        new (&kb_obj) KeyboardInterface(wide_pin_settings);
+    }
+
+    /**
+    * @name   bench_attach_matrix
+    * @brief  Attach a matrix of device models wired to the selected pinout.
+    *         Every device gets its own key scan state and register contents.
+    */
+    void bench_attach_matrix(bench_family_e family, uint8_t num_columns, uint8_t num_rows, uint8_t num_channels)
+    {
+        const pin_settings_t &pins = *bench_pins;
+        uint32_t seed = 0x1234567;
+
+        for (uint8_t i = 0; i < num_columns; i++)
+        {
+            for (uint8_t j = 0; j < num_rows; j++)
+            {
+                SimDevice *device;
+                seed = seed*1103515245 + 12345;
+
+                if (family == bench_iqs9320)
+                {
+                    SimIqs9320 *iqs9320 = new SimIqs9320(pins.c0_msk[i], pins.r0_msk[j], pins.r1_msk[j],
+                                                         pins.r2_msk[j], pins.r3_msk[j], num_channels);
+                    iqs9320->key_scan_state = (seed >> 8) & ((1 << (2 + num_channels)) - 1);
+                    device = iqs9320;
+                }
+                else
+                {
+                    SimIqs7220a *iqs7x20a;
+                    if (family == bench_iqs7320a)
+                        iqs7x20a = new SimIqs7320a(pins.s0_msk[i], pins.s1_msk[i], pins.d0_msk[j], pins.d1_msk[j]);
+                    else
+                        iqs7x20a = new SimIqs7220a(pins.s0_msk[i], pins.s1_msk[i], pins.d0_msk[j], pins.d1_msk[j]);
+                    iqs7x20a->key_scan_state = (seed >> 8) & 0x1F;
+                    device = iqs7x20a;
+                }
+
+                for (size_t k = 0; k < device->registers.size(); k++)
+                {
+                    device->registers[k] = (uint8_t)(k + 17*bench_devices.size());
+                }
+
+                bench_devices.push_back(device);
+                attach(device);
+            }
+        }
+    }
+
+    /**
+    * @name   bench_frame
+    * @brief  Build a serial command frame.
+    */
+    std::vector<uint8_t> bench_frame(const std::vector<uint8_t> &packet)
+    {
+        static uint8_t frame_id;
+        std::vector<uint8_t> data;
+
+        data.push_back(frame_id++);
+        data.insert(data.end(), packet.begin(), packet.end());
+        uint16_t crc = kb_obj.get_crc(data.data(), data.size());
+
+        std::vector<uint8_t> frame;
+        frame.push_back(SERIAL_HEADER_A);
+        frame.push_back(SERIAL_HEADER_B);
+        frame.push_back((uint8_t)data.size());
+        for (uint8_t value : data) frame.push_back(value);
+        frame.push_back(crc & 0xFF);
+        frame.push_back(crc >> 8);
+        frame.push_back(SERIAL_HEADER_A);
+        frame.push_back(SERIAL_HEADER_B);
+        return frame;
+    }
+
+    /**
+    * @name   bench_skip_stream_frames
+    * @brief  Number of bytes taken by complete, valid stream frames at the start of the output.
+    */
+    static size_t bench_skip_stream_frames(const std::vector<uint8_t> &output, size_t i)
+    {
+        while ((i + 3 <= output.size()) && (output[i] == SERIAL_HEADER_A) && (output[i+1] == SERIAL_HEADER_B))
+        {
+            uint8_t len = output[i+2];
+            if ((len < STREAM_HEADER_LEN) || (i + len + 7 > output.size())) break;
+
+            uint16_t crc = output[i+len+3] | (output[i+len+4] << 8);
+            if ((kb_obj.get_crc((uint8_t*)&output[i+3], len) != crc) ||
+                (output[i+len+5] != SERIAL_HEADER_A) || (output[i+len+6] != SERIAL_HEADER_B)) break;
+            i += len + 7;
+        }
+        return i;
+    }
+
+    /**
+    * @name   bench_command
+    * @brief  Send a command and run loop() until it has been acknowledged and executed.
+    *         A command received during a stream key scan is only executed once the
+    *         scan has completed, stream frames sent before the response are dropped.
+    * @retval Virtual time in nanoseconds from the first byte to the end of the response
+    */
+    uint64_t bench_command(const std::vector<uint8_t> &packet, std::vector<uint8_t> &response)
+    {
+        std::vector<uint8_t> frame = bench_frame(packet);
+        const uint8_t ack[6] = {SERIAL_HEADER_A, SERIAL_HEADER_B, frame[3], frame[4], SERIAL_HEADER_A, SERIAL_HEADER_B};
+        std::vector<uint8_t> output;
+        size_t ack_end = 0;
+
+        Serial.take_output();
+        uint32_t write_calls = Serial.write_calls;
+        uint64_t start_ns = time_ns();
+        Serial.inject(frame.data(), frame.size());
+
+        // Command has executed when it was acknowledged and the loop stopped producing output
+        uint64_t end_ns = start_ns;
+        uint32_t idle_loops = 0;
+        while (((ack_end == 0) && (time_ns() - start_ns < 100000000)) || (idle_loops < 8))
+        {
+            uint32_t bytes_written = Serial.bytes_written;
+            bool receiving = Serial.available();
+
+            sketch_loop();
+            if (receiving || (Serial.bytes_written != bytes_written))
+            {
+                end_ns = time_ns();
+                idle_loops = 0;
+            }
+            else
+            {
+                idle_loops++;
+            }
+            advance_ns(HOST_LOOP_NS);
+
+            std::vector<uint8_t> data = Serial.take_output();
+            output.insert(output.end(), data.begin(), data.end());
+            if (ack_end == 0)
+            {
+                auto ack_start = std::search(output.begin(), output.end(), ack, ack + 6);
+                if (ack_start != output.end()) ack_end = ack_start - output.begin() + 6;
+            }
+        }
+        uint64_t elapsed_ns = end_ns - start_ns;
+        bench_write_calls = Serial.write_calls - write_calls;
+
+        // Strip the packet acknowledge and the stream samples that completed before the command
+        response.assign(output.begin() + bench_skip_stream_frames(output, ack_end), output.end());
+        return elapsed_ns;
+    }
+
+    /**
+    * @name   bench_report
+    * @brief  Print a timing result and compare the response with the expected data.
+    */
+    void bench_report(const char *name, uint64_t elapsed_ns, const std::vector<uint8_t> &response,
+                      const std::vector<uint8_t> &expected)
+    {
+        bool match = (response == expected);
+        if (!match) bench_failures++;
+        if (!match && getenv("BENCH_DEBUG"))
+        {
+            for (size_t i = 0; i < response.size() || i < expected.size(); i++)
+                printf("%zu: %02x %02x\n", i, i < response.size() ? response[i] : 0xAA, i < expected.size() ? expected[i] : 0xAA);
+        }
+
+        printf("%-36s %10.1f us  %4zu bytes  %3u writes  %s\n", name, elapsed_ns/1000.0, response.size(), bench_write_calls,
+               match ? "ok" : "MISMATCH");
+    }
+
+    /**
+    * @name   bench_parse_stream
+    * @brief  Split serial output into stream samples. Every frame must have a valid
+    *         length, CRC16 and EOF and the fragments of a sample must be in order.
+    * @retval False on the first framing error
+    */
+    bool bench_parse_stream(const std::vector<uint8_t> &output, std::vector<bench_sample_t> &samples)
+    {
+        bench_sample_t sample = {};
+        uint8_t fragment = 0;
+        size_t i = 0;
+
+        while (i < output.size())
+        {
+            if ((i + 3 > output.size()) || (output[i] != SERIAL_HEADER_A) || (output[i+1] != SERIAL_HEADER_B)) return false;
+
+            uint8_t len = output[i+2];
+            if ((len < STREAM_HEADER_LEN) || (i + len + 7 > output.size())) return false;
+
+            const uint8_t *frame = &output[i+3];
+            uint16_t crc = output[i+len+3] | (output[i+len+4] << 8);
+            if ((kb_obj.get_crc((uint8_t*)frame, len) != crc) ||
+                (output[i+len+5] != SERIAL_HEADER_A) || (output[i+len+6] != SERIAL_HEADER_B)) return false;
+
+            if ((frame[8] & ~STREAM_FRAGMENT_LAST) != fragment) return false;
+            if (fragment == 0)
+            {
+                sample.stream_id = frame[0];
+                sample.command = frame[1];
+                sample.sequence = frame[2] | (frame[3] << 8);
+                sample.timestamp = frame[4] | (frame[5] << 8) | (frame[6] << 16) | ((uint32_t)frame[7] << 24);
+                sample.data.clear();
+            }
+            sample.data.insert(sample.data.end(), &frame[STREAM_HEADER_LEN], &frame[len]);
+            fragment++;
+
+            if (frame[8] & STREAM_FRAGMENT_LAST)
+            {
+                samples.push_back(sample);
+                fragment = 0;
+            }
+            i += len + 7;
+        }
+
+        return fragment == 0;
+    }
+
+    /**
+    * @name   bench_stream
+    * @brief  Start a stream, optionally change its interval to interval_us, run for
+    *         the given virtual time and verify that every sample arrived framed,
+    *         in sequence and with the expected data.
+    */
+    void bench_stream(const char *name, const std::vector<uint8_t> &packet, uint32_t run_us,
+                      const std::vector<uint8_t> &expected, uint32_t interval_us)
+    {
+        std::vector<uint8_t> response;
+        std::vector<bench_sample_t> samples;
+
+        bench_command(packet, response);
+        if (interval_us)
+        {
+            bench_command({cmd_stream_interval, 0, (uint8_t)interval_us, (uint8_t)(interval_us >> 8),
+                           (uint8_t)(interval_us >> 16), (uint8_t)(interval_us >> 24)}, response);
+        }
+
+        uint32_t write_calls = Serial.write_calls;
+        uint32_t i2c_transfers = 0;
+        for (SimDevice *device : bench_devices) i2c_transfers -= device->i2c_transfers;
+        // Run for the requested time, then until the last sample has been sent.
+        // Every loop() that returns is time the sketch could spend on other work.
+        uint64_t end_ns = time_ns() + (uint64_t)run_us*1000;
+        uint32_t idle_loops = 0, loops = 0;
+        while ((time_ns() < end_ns) || (idle_loops < 8))
+        {
+            uint32_t bytes_written = Serial.bytes_written;
+
+            sketch_loop();
+            loops++;
+            idle_loops = (Serial.bytes_written != bytes_written) ? 0 : idle_loops + 1;
+            advance_ns(HOST_LOOP_NS);
+        }
+        std::vector<uint8_t> output = Serial.take_output();
+        write_calls = Serial.write_calls - write_calls;
+        for (SimDevice *device : bench_devices) i2c_transfers += device->i2c_transfers;
+        bench_command({cmd_stop_streaming}, response);
+
+        bool match = bench_parse_stream(output, samples) && !samples.empty();
+        for (size_t i = 0; match && (i < samples.size()); i++)
+        {
+            if (getenv("BENCH_DEBUG") && (samples[i].data != expected))
+                for (size_t k = 0; k < samples[i].data.size() || k < expected.size(); k++)
+                    printf("%zu: %02x %02x\n", k, k < samples[i].data.size() ? samples[i].data[k] : 0xAA, k < expected.size() ? expected[k] : 0xAA);
+            match = (samples[i].command == packet[0]) && (samples[i].sequence == i) && (samples[i].data == expected) &&
+                    ((i == 0) || (samples[i].timestamp > samples[i-1].timestamp));
+        }
+        if (!match) bench_failures++;
+
+        double period_us = (samples.size() > 1) ? (samples.back().timestamp - samples.front().timestamp)/(samples.size() - 1.0) : 0;
+        printf("%-36s %10.1f us  %4zu bytes  %3u writes  %s (%zu samples, %u loops, %u i2c)\n", name, period_us, output.size(), write_calls,
+               match ? "ok" : "MISMATCH", samples.size(), loops, i2c_transfers);
+    }
+
+    /**
+    * @name   bench_stream_rejected
+    * @brief  Send a stream setup whose registers do not fit the stream or input_data.
+    *         The setup must not be acknowledged and no stream sample may follow.
+    */
+    void bench_stream_rejected(const char *name, const std::vector<uint8_t> &packet)
+    {
+        std::vector<uint8_t> response;
+        uint64_t elapsed_ns;
+
+        elapsed_ns = bench_command(packet, response);
+        bench_report(name, elapsed_ns, response, {});
+        bench_command({cmd_stop_streaming}, response);
+    }
+
+    /**
+    * @name   bench_stream_batch
+    * @brief  Run an I2C stream of every device while the first device acknowledges the
+    *         configuration state later than CONFIG_ACK_TIMEOUT, its registers must be
+    *         returned as zeros and the other devices read. Then run a stream of a single
+    *         device, which must be the only device read.
+    * @param  multi_packet -> Stream setup of every device
+    * @param  single_packet -> Stream setup of the last device of the matrix, same registers
+    * @param  expected -> Register data of every device, per device
+    */
+    void bench_stream_batch(const char *name, const std::vector<uint8_t> &multi_packet, const std::vector<uint8_t> &single_packet,
+                            const std::vector<uint8_t> &expected)
+    {
+        size_t device_len = expected.size()/bench_devices.size();
+        std::vector<uint8_t> expected_timeout(expected);
+        std::vector<uint8_t> expected_single(expected.end() - device_len, expected.end());
+        std::vector<uint32_t> transfers;
+        std::string label;
+        bool match = true;
+
+        std::fill(expected_timeout.begin(), expected_timeout.begin() + device_len, 0);
+        bench_devices[0]->ack_ns = 2*CONFIG_ACK_TIMEOUT*1000;
+        label = std::string(name) + " ack timeout";
+        bench_stream(label.c_str(), multi_packet, 50000, expected_timeout);
+        bench_devices[0]->ack_ns = SIM_ACK_NS;
+
+        for (SimDevice *device : bench_devices) transfers.push_back(device->i2c_transfers);
+        label = std::string(name) + " single device";
+        bench_stream(label.c_str(), single_packet, 50000, expected_single);
+        for (size_t i = 0; i + 1 < bench_devices.size(); i++)
+        {
+            match = match && (bench_devices[i]->i2c_transfers == transfers[i]);
+        }
+        match = match && (bench_devices.back()->i2c_transfers > transfers.back());
+        label = std::string(name) + " single device only";
+        bench_report(label.c_str(), 0, {match}, {true});
+    }
+
+    /**
+    * @name   bench_stream_concurrent
+    * @brief  Run several streams at the same time and verify that every stream
+    *         gets its own slot with in sequence samples and the expected data.
+    */
+    void bench_stream_concurrent(const char *name, const std::vector<std::vector<uint8_t>> &packets, uint32_t run_us,
+                                 const std::vector<std::vector<uint8_t>> &expected)
+    {
+        std::vector<uint8_t> response;
+        std::vector<bench_sample_t> samples;
+
+        for (const std::vector<uint8_t> &packet : packets) bench_command(packet, response);
+
+        uint64_t end_ns = time_ns() + (uint64_t)run_us*1000;
+        uint32_t idle_loops = 0;
+        while ((time_ns() < end_ns) || (idle_loops < 8))
+        {
+            uint32_t bytes_written = Serial.bytes_written;
+
+            sketch_loop();
+            idle_loops = (Serial.bytes_written != bytes_written) ? 0 : idle_loops + 1;
+            advance_ns(HOST_LOOP_NS);
+        }
+        std::vector<uint8_t> output = Serial.take_output();
+
+        // Missed deadlines per stream
+        std::vector<uint32_t> missed;
+        for (size_t i = 0; i < packets.size(); i++)
+        {
+            bench_command({cmd_stream_stats, (uint8_t)i}, response);
+            missed.push_back((response.size() == 8) ? (response[4] | (response[5] << 8) | (response[6] << 16) | ((uint32_t)response[7] << 24)) : 0);
+        }
+        bench_command({cmd_stop_streaming}, response);
+
+        bool match = bench_parse_stream(output, samples);
+        std::vector<uint32_t> counts(packets.size(), 0);
+        for (const bench_sample_t &sample : samples)
+        {
+            // Streams started in order use slots 0, 1, ...
+            if ((sample.stream_id >= packets.size()) || (sample.command != packets[sample.stream_id][0]) ||
+                (sample.sequence != counts[sample.stream_id]) || (sample.data != expected[sample.stream_id]))
+            {
+                match = false;
+                break;
+            }
+            counts[sample.stream_id]++;
+        }
+        for (uint32_t count : counts) match = match && (count > 0);
+        if (!match) bench_failures++;
+
+        printf("%-36s %10s     %4zu bytes  %3s         %s (", name, "", output.size(), "", match ? "ok" : "MISMATCH");
+        for (size_t i = 0; i < counts.size(); i++) printf("%s%u", i ? "/" : "", counts[i]);
+        printf(" samples, ");
+        for (size_t i = 0; i < missed.size(); i++) printf("%s%u", i ? "/" : "", missed[i]);
+        printf(" missed)\n");
+    }
+
+    /**
+    * @name   bench_key_scan_state
+    * @brief  Key scan state of a device model, optionally toggling a channel first.
+    */
+    static uint32_t bench_key_scan_state(bench_family_e family, SimDevice *device, uint32_t toggle = 0)
+    {
+        if (family == bench_iqs9320) return ((SimIqs9320*)device)->key_scan_state ^= toggle;
+        return ((SimIqs7220a*)device)->key_scan_state ^= toggle;
+    }
+
+    /**
+    * @name   bench_stream_delta
+    * @brief  Stream key scans in delta mode while channel states change, rebuild
+    *         the matrix from the keyframes and deltas and compare it with the models.
+    *         A second key scan stream must be rejected while delta mode is selected.
+    */
+    void bench_stream_delta(const char *name, bench_family_e family, const std::vector<uint8_t> &packet, uint8_t num_bytes)
+    {
+        std::vector<uint8_t> response, output;
+        std::vector<bench_sample_t> samples;
+        std::vector<uint32_t> states(bench_devices.size());
+        uint8_t other = (packet[0] == cmd_iqs7220a_stream_ks) ? cmd_iqs7320a_stream_ks : cmd_iqs7220a_stream_ks;
+        bool match = true;
+        bool rejected;
+
+        // Delta mode is not selected while two key scan streams run, and a second
+        // key scan stream is not started in delta mode
+        bench_command(packet, response);
+        bench_command({other, 1}, response);
+        bench_command({cmd_stream_ks_mode, stream_ks_delta, 8}, response);
+        rejected = response.empty();
+        bench_command({cmd_stop_streaming}, response);
+
+        bench_command({cmd_stream_ks_mode, stream_ks_delta, 8}, response);
+        bench_command(packet, response);
+        bench_command({other, 1}, response);
+        rejected = rejected && response.empty();
+
+        // 20 samples, a channel changes on every 3rd sample
+        uint32_t write_calls = Serial.write_calls;
+        for (uint32_t sample = 0; sample < 20; sample++)
+        {
+            if (sample % 3 == 2) bench_key_scan_state(family, bench_devices[sample % bench_devices.size()], 0x04);
+
+            uint64_t end_ns = time_ns() + 1000000;
+            while (time_ns() < end_ns)
+            {
+                sketch_loop();
+                advance_ns(HOST_LOOP_NS);
+            }
+            std::vector<uint8_t> data = Serial.take_output();
+            output.insert(output.end(), data.begin(), data.end());
+        }
+        write_calls = Serial.write_calls - write_calls;
+        bench_command({cmd_stop_streaming}, response);
+        bench_command({cmd_stream_ks_mode, stream_ks_full, 0}, response);
+
+        match = rejected && bench_parse_stream(output, samples) && !samples.empty();
+        for (size_t i = 0; match && (i < samples.size()); i++)
+        {
+            const std::vector<uint8_t> &data = samples[i].data;
+            match = (samples[i].sequence == i) && !data.empty();
+            if (!match) break;
+
+            if (data[0] == ks_sample_keyframe)
+            {
+                match = (data.size() == 1 + num_bytes*states.size());
+                for (size_t j = 0; match && (j < states.size()); j++)
+                {
+                    states[j] = 0;
+                    for (uint8_t k = 0; k < num_bytes; k++) states[j] |= data[1 + j*num_bytes + k] << (8*k);
+                }
+            }
+            else
+            {
+                match = (i > 0) && ((data.size() - 1) % (1 + num_bytes) == 0);
+                for (size_t j = 1; match && (j < data.size()); j += 1 + num_bytes)
+                {
+                    match = (data[j] < states.size());
+                    if (!match) break;
+                    states[data[j]] = 0;
+                    for (uint8_t k = 0; k < num_bytes; k++) states[data[j]] |= data[j + 1 + k] << (8*k);
+                }
+            }
+        }
+        for (size_t j = 0; match && (j < states.size()); j++)
+        {
+            match = (states[j] == bench_key_scan_state(family, bench_devices[j]));
+        }
+        if (!match) bench_failures++;
+
+        printf("%-36s %10s     %4zu bytes  %3u writes  %s (%zu samples)\n", name, "", output.size(), write_calls,
+               match ? "ok" : "MISMATCH", samples.size());
+    }
+
+    /**
+    * @name   bench_stream_stop_scan
+    * @brief  Stop all streams while a stream key scan is in progress. Commands are
+    *         only executed between scans, so the stop is called directly. The scan
+    *         must end with the column lines released and without sending its sample,
+    *         and the next block key scan must return the models.
+    */
+    void bench_stream_stop_scan(const char *name, const std::vector<uint8_t> &packet, const std::vector<uint8_t> &block_packet,
+                                const std::vector<uint8_t> &expected)
+    {
+        std::vector<uint8_t> response, output;
+        uint64_t elapsed_ns;
+        bool match;
+
+        bench_command(packet, response);
+
+        // Run until the scan drives its first column line, then a few more phases
+        uint64_t end_ns = time_ns() + 10000000;
+        while ((gpio_mcu_low() == 0) && (time_ns() < end_ns))
+        {
+            sketch_loop();
+            advance_ns(HOST_LOOP_NS);
+        }
+        for (uint32_t i = 0; i < 20; i++)
+        {
+            sketch_loop();
+            advance_ns(HOST_LOOP_NS);
+        }
+        Serial.take_output();
+        match = (gpio_mcu_low() != 0);
+
+        kb_obj.stream_stop_all();
+        match = match && (gpio_mcu_low() == 0);
+
+        // No sample of the cancelled scan follows
+        end_ns = time_ns() + 2000000;
+        while (time_ns() < end_ns)
+        {
+            sketch_loop();
+            advance_ns(HOST_LOOP_NS);
+        }
+        output = Serial.take_output();
+        match = match && output.empty();
+
+        elapsed_ns = bench_command(block_packet, response);
+        match = match && (response == expected);
+        bench_report(name, elapsed_ns, {match}, {true});
+    }
+
+    /**
+    * @name   bench_key_scan_pipelined
+    * @brief  Run a blocking key scan in the pipelined scan mode, once with the
+    *         default device settle time and once with devices that take the full
+    *         SCAN_DELAY (less the 1 us timer resolution) to settle, so that every read
+    *         of a column overlapping the previous column happens at the latest settle time.
+    */
+    void bench_key_scan_pipelined(const char *name, const std::vector<uint8_t> &packet, const std::vector<uint8_t> &expected)
+    {
+        std::vector<uint8_t> response;
+        std::string label(name);
+        uint64_t elapsed_ns;
+
+        bench_command({cmd_scan_mode, scan_pipelined}, response);
+
+        elapsed_ns = bench_command(packet, response);
+        bench_report((label + " pipelined").c_str(), elapsed_ns, response, expected);
+
+        for (SimDevice *device : bench_devices) device->settle_ns = (SCAN_DELAY - 1)*1000;
+        elapsed_ns = bench_command(packet, response);
+        bench_report((label + " pipelined, slow").c_str(), elapsed_ns, response, expected);
+        for (SimDevice *device : bench_devices) device->settle_ns = SIM_SETTLE_NS;
+
+        bench_command({cmd_scan_mode, scan_sequential}, response);
+    }
+
+    /**
+    * @name   bench_key_scan_calibrated
+    * @brief  Calibrate the scan delays against the device models and run a blocking
+    *         key scan with the calibrated delays, then restore the default delays.
+    */
+    void bench_key_scan_calibrated(const char *name, const std::vector<uint8_t> &packet, uint8_t num_channels,
+                                   const std::vector<uint8_t> &expected)
+    {
+        std::vector<uint8_t> response;
+        char label[64];
+        uint64_t elapsed_ns;
+
+        bench_command({cmd_scan_delay_calibrate, num_channels}, response);
+        if (response.size() != SCAN_DELAY_PHASES)
+        {
+            bench_failures++;
+            printf("%-36s %10s     %4zu bytes  %3s         MISMATCH\n", name, "", response.size(), "");
+            return;
+        }
+        snprintf(label, sizeof(label), "%s %u/%u/%u/%u us", name, response[0], response[1], response[2], response[3]);
+
+        elapsed_ns = bench_command(packet, response);
+        bench_report(label, elapsed_ns, response, expected);
+
+        bench_command({cmd_scan_delay_write, 0, 0, 0, 0}, response);
+    }
+
+    /**
+    * @name   bench_config_timeout
+    * @brief  Run an I2C read on the first device while it acknowledges the configuration
+    *         state later than CONFIG_ACK_TIMEOUT, and verify that the configuration status
+    *         reports the timeout once and that the read is skipped and returns zeros.
+    */
+    void bench_config_timeout(const char *name, const std::vector<uint8_t> &packet)
+    {
+        std::vector<uint8_t> response, status;
+        uint64_t elapsed_ns;
+        uint16_t timeouts;
+
+        bench_command({cmd_config_status}, status);
+        timeouts = (status.size() == 3) ? (status[1] | (status[2] << 8)) : 0;
+
+        bench_devices[0]->ack_ns = 2*CONFIG_ACK_TIMEOUT*1000;
+        elapsed_ns = bench_command(packet, response);
+        bench_devices[0]->ack_ns = SIM_ACK_NS;
+
+        bench_command({cmd_config_status}, status);
+        timeouts++;
+        bench_report(name, elapsed_ns, status, {config_ack_timeout, (uint8_t)timeouts, (uint8_t)(timeouts >> 8)});
+        bench_report("config timeout read skipped", 0, response, std::vector<uint8_t>(packet.back(), 0));
+
+        // Flags are cleared once read
+        bench_command({cmd_config_status}, status);
+        bench_report("config status cleared", 0, status, {config_ok, (uint8_t)timeouts, (uint8_t)(timeouts >> 8)});
+    }
+
+    /**
+    * @name   bench_device_errors
+    * @brief  Read the error counters of a device: NACK, bus timeout, configuration
+    *         timeout and bus recoveries.
+    */
+    static std::vector<uint16_t> bench_device_errors(uint8_t device_index)
+    {
+        std::vector<uint8_t> response;
+        std::vector<uint16_t> counts(4, 0);
+
+        bench_command({cmd_device_errors, device_index}, response);
+        for (size_t i = 0; (i < counts.size()) && (2*i + 1 < response.size()); i++)
+        {
+            counts[i] = response[2*i] | (response[2*i + 1] << 8);
+        }
+        return counts;
+    }
+
+    /**
+    * @name   bench_bus_recovery
+    * @brief  Hold SDA LOW while an I2C command runs on the first device, and while a
+    *         stream reads it. Both must end within the timeout and report the error,
+    *         after which the recovered bus must return the expected data.
+    */
+    void bench_bus_recovery(const char *name, const std::vector<uint8_t> &packet, const std::vector<uint8_t> &stream_packet,
+                            const std::vector<uint8_t> &expected)
+    {
+        static SimBusHold hold(1UL << bench_pins->pin_sda_0, 1UL << bench_pins->pin_scl_0, 0);
+        std::vector<uint8_t> response, status;
+        std::vector<uint16_t> before, after;
+        uint64_t elapsed_ns;
+        bool match;
+
+        attach(&hold);
+        bench_command({cmd_config_status}, status);
+        before = bench_device_errors(0);
+
+        // Blocking Wire transfer
+        hold.pulses = 3;
+        elapsed_ns = bench_command(packet, response);
+        bench_command({cmd_config_status}, status);
+        after = bench_device_errors(0);
+        match = (hold.pulses == 0) && (status.size() == 3) && (status[0] & config_i2c_timeout) &&
+                (after[1] == before[1] + 1) && (after[3] == before[3] + 1);
+        bench_report(name, elapsed_ns, {match}, {true});
+
+        elapsed_ns = bench_command(packet, response);
+        bench_report("i2c after bus recovery", elapsed_ns, response, expected);
+
+        // Queued transfer of a stream sample
+        hold.pulses = 3;
+        bench_command(stream_packet, response);
+        uint64_t end_ns = time_ns() + 20000000ULL;
+        while (time_ns() < end_ns)
+        {
+            sketch_loop();
+            advance_ns(HOST_LOOP_NS);
+        }
+        bench_command({cmd_stop_streaming}, response);
+        Serial.take_output();
+        bench_command({cmd_config_status}, status);
+        before = after;
+        after = bench_device_errors(0);
+        match = (hold.pulses == 0) && (status.size() == 3) && (status[0] & config_i2c_timeout) &&
+                (after[1] == before[1] + 1) && (after[3] == before[3] + 1);
+        bench_report("i2c stream bus recovery", 0, {match}, {true});
+    }
+
+    /**
+    * @name   bench_cache_stats
+    * @brief  Read the register cache counters: write hits, write misses, read hits and read misses.
+    */
+    static std::vector<uint32_t> bench_cache_stats()
+    {
+        std::vector<uint8_t> response;
+        std::vector<uint32_t> counts(4, 0);
+
+        bench_command({cmd_register_cache_stats}, response);
+        for (size_t i = 0; (i < counts.size()) && (4*i + 3 < response.size()); i++)
+        {
+            counts[i] = response[4*i] | (response[4*i + 1] << 8) | (response[4*i + 2] << 16) | ((uint32_t)response[4*i + 3] << 24);
+        }
+        return counts;
+    }
+
+    /**
+    * @name   bench_register_cache
+    * @brief  Write the same registers to every device twice. Outside a skip range the
+    *         second write must reach the devices, within it the second write must be
+    *         skipped. A device that changed the registers on its own is written again
+    *         after a read shows the change. Then mark a range static and read it twice,
+    *         the second read must be served from the cache with the same data.
+    * @param  write_packet -> Write multi command, the data starts at data_index
+    * @param  write_offset -> Byte offset of the written registers in the device model
+    * @param  skip_packet -> Write Skip Range command covering the write
+    * @param  verify_packet -> Read multi command of the written registers
+    * @param  static_packet -> Static Register Range command covering the read
+    * @param  read_packet -> Read multi command of the static registers
+    * @param  read_offset -> Byte offset of the read registers in the device model
+    */
+    void bench_register_cache(const char *name, const std::vector<uint8_t> &write_packet, size_t data_index, size_t write_offset,
+                              const std::vector<uint8_t> &skip_packet, const std::vector<uint8_t> &verify_packet,
+                              const std::vector<uint8_t> &static_packet, const std::vector<uint8_t> &read_packet, size_t read_offset)
+    {
+        const std::vector<uint8_t> standard = {0xFF, 0xFF, 0xFF, 0xFF};
+        std::vector<uint8_t> response, expected;
+        std::vector<uint32_t> before, after;
+        std::string label;
+        uint64_t elapsed_ns;
+        size_t read_len = read_packet.back();
+        size_t write_len = write_packet.size() - data_index;
+        bool match;
+
+        // Every device holds the written data
+        auto written = [&]() {
+            bool all = true;
+            for (SimDevice *device : bench_devices)
+            {
+                all = all && std::equal(write_packet.begin() + data_index, write_packet.end(), device->registers.begin() + write_offset);
+            }
+            return all;
+        };
+
+        bench_command({cmd_register_cache_invalidate, 0xFF}, response);
+        before = bench_cache_stats();
+
+        // Outside a skip range every write reaches the devices, like a self-clearing command bit
+        bench_command(write_packet, response);
+        for (SimDevice *device : bench_devices)
+        {
+            std::fill(device->registers.begin() + write_offset, device->registers.begin() + write_offset + write_len, 0);
+        }
+        elapsed_ns = bench_command(write_packet, response);
+        after = bench_cache_stats();
+        match = (response == standard) && written() && (after[0] == before[0]);
+        label = std::string(name) + " write unskipped";
+        bench_report(label.c_str(), elapsed_ns, {match}, {true});
+
+        // First write within a skip range goes to every device
+        bench_command(skip_packet, response);
+        before = bench_cache_stats();
+        elapsed_ns = bench_command(write_packet, response);
+        match = (response == standard) && written();
+        label = std::string(name) + " write";
+        bench_report(label.c_str(), elapsed_ns, {match}, {true});
+
+        // The repeated write is skipped on every device
+        elapsed_ns = bench_command(write_packet, response);
+        after = bench_cache_stats();
+        match = (response == standard) && (after[0] == before[0] + bench_devices.size()) &&
+                (after[1] == before[1] + bench_devices.size());
+        label = std::string(name) + " write cached";
+        bench_report(label.c_str(), elapsed_ns, {match}, {true});
+
+        // A read showing a changed register drops the shadow of the device, it is written again
+        bench_devices[0]->registers[write_offset] ^= 0xFF;
+        bench_command(verify_packet, response);
+        before = after;
+        elapsed_ns = bench_command(write_packet, response);
+        after = bench_cache_stats();
+        match = (response == standard) && written() && (after[0] == before[0] + bench_devices.size() - 1) &&
+                (after[1] == before[1] + 1);
+        label = std::string(name) + " write after change";
+        bench_report(label.c_str(), elapsed_ns, {match}, {true});
+
+        // Static registers are read once
+        for (SimDevice *device : bench_devices)
+        {
+            expected.insert(expected.end(), device->registers.begin() + read_offset, device->registers.begin() + read_offset + read_len);
+        }
+        bench_command(static_packet, response);
+        elapsed_ns = bench_command(read_packet, response);
+        label = std::string(name) + " static read";
+        bench_report(label.c_str(), elapsed_ns, response, expected);
+
+        elapsed_ns = bench_command(read_packet, response);
+        before = after;
+        after = bench_cache_stats();
+        label = std::string(name) + " static read cached";
+        bench_report(label.c_str(), elapsed_ns, response, (after[2] == before[2] + bench_devices.size()) ? expected : std::vector<uint8_t>());
+
+        // Clear the skip and static ranges and the shadow for the tests that follow
+        bench_command({cmd_register_cache_skip, 0, 0, 0}, response);
+        bench_command({cmd_register_cache_static, 0, 0, 0}, response);
+        bench_command({cmd_register_cache_invalidate, 0xFF}, response);
+    }
+
+    /**
+    * @name   bench_run
+    * @brief  Run the timing benchmark for a matrix of the given device family.
+    * @retval Number of commands that returned unexpected data
+    */
+    uint32_t bench_run(bench_family_e family, uint8_t num_columns, uint8_t num_rows, uint8_t num_channels)
+    {
+        std::vector<uint8_t> response, expected, expected_ks, expected_batch;
+        uint64_t elapsed_ns;
+        uint8_t num_devices = num_columns*num_rows;
+        uint8_t device_e_value = (family == bench_iqs9320) ? dev_iqs9320_ks : (family == bench_iqs7320a) ? dev_iqs7320a : dev_iqs7220a;
+
+        bench_failures = 0;
+        bench_attach_matrix(family, num_columns, num_rows, num_channels);
+
+        // A rejected setup leaves every command disabled, the scan delay read only answers after a valid setup
+        elapsed_ns = bench_command({cmd_setup, device_e_value, num_columns, num_rows}, response);
+        bench_command({cmd_scan_delay_read}, response);
+        bench_report("device setup", elapsed_ns, {response.size() == SCAN_DELAY_PHASES}, {true});
+        if (response.size() != SCAN_DELAY_PHASES)
+        {
+            printf("%u devices, %u mismatches\n", num_devices, bench_failures);
+            return bench_failures;
+        }
+
+        if (family == bench_iqs9320)
+        {
+            // Key scan, 3 bytes per device
+            for (SimDevice *device : bench_devices)
+            {
+                uint32_t state = ((SimIqs9320*)device)->key_scan_state;
+                expected.push_back(state & 0xFF);
+                expected.push_back((state >> 8) & 0xFF);
+                expected.push_back((state >> 16) & 0xFF);
+            }
+            elapsed_ns = bench_command({cmd_iqs9320_block_ks, num_channels}, response);
+            bench_report("iqs9320 key scan", elapsed_ns, response, expected);
+            bench_key_scan_pipelined("iqs9320 key scan", {cmd_iqs9320_block_ks, num_channels}, expected);
+            bench_key_scan_calibrated("iqs9320 calibrated", {cmd_iqs9320_block_ks, num_channels}, num_channels, expected);
+            bench_stream("iqs9320 key scan stream (period)", {cmd_iqs9320_stream_ks, 1, num_channels}, 5000, expected);
+            bench_stream("iqs9320 key scan 700 us (period)", {cmd_iqs9320_stream_ks, 1, num_channels}, 5000, expected, 700);
+            bench_stream_delta("iqs9320 key scan delta stream (20 ms)", family, {cmd_iqs9320_stream_ks, 1, num_channels}, 3);
+            for (SimDevice *device : bench_devices)
+            {
+                uint32_t state = bench_key_scan_state(family, device);
+                expected_ks.push_back(state & 0xFF);
+                expected_ks.push_back((state >> 8) & 0xFF);
+                expected_ks.push_back((state >> 16) & 0xFF);
+            }
+            bench_stream_stop_scan("iqs9320 key scan stream stopped", {cmd_iqs9320_stream_ks, 1, num_channels},
+                                   {cmd_iqs9320_block_ks, num_channels}, expected_ks);
+
+            // A channel count beyond the key scan bitplanes is rejected, the next key scan is unaffected
+            elapsed_ns = bench_command({cmd_iqs9320_block_ks, 255}, response);
+            bench_report("iqs9320 key scan 255 ch rejected", elapsed_ns, response, {});
+            elapsed_ns = bench_command({cmd_scan_delay_calibrate, IQS9320_MAX_CHANNELS + 1}, response);
+            bench_report("iqs9320 calibrate 21 ch rejected", elapsed_ns, response, {});
+            bench_stream_rejected("iqs9320 ks stream 255 ch rejected", {cmd_iqs9320_stream_ks, 1, 255});
+            elapsed_ns = bench_command({cmd_iqs9320_block_ks, num_channels}, response);
+            bench_report("iqs9320 key scan after rejected", elapsed_ns, response, expected_ks);
+
+            // I2C read from every device
+            expected.clear();
+            for (SimDevice *device : bench_devices)
+            {
+                expected.insert(expected.end(), &device->registers[0x1000], &device->registers[0x1000 + 20]);
+            }
+            elapsed_ns = bench_command({cmd_iqs9320_block_ks_i2c_read_multi, 0x30, 0x00, 0x10, 20}, response);
+            bench_report("iqs9320 i2c read multi (20 bytes)", elapsed_ns, response, expected);
+            bench_config_timeout("iqs9320 i2c ack timeout", {cmd_iqs9320_block_ks_i2c_read_single, 0, 0x30, 0x00, 0x10, 20});
+            bench_bus_recovery("iqs9320 i2c bus recovery", {cmd_iqs9320_block_ks_i2c_read_single, 0, 0x30, 0x00, 0x10, 20},
+                               {cmd_iqs9320_stream_ks_i2c_read_multi, 10, 0x30, 1, 0x00, 0x10, 20},
+                               std::vector<uint8_t>(expected.begin(), expected.begin() + 20));
+            bench_register_cache("iqs9320 cache", {cmd_iqs9320_block_ks_i2c_write_multi, 0x30, 0x00, 0x30, 4, 1, 2, 3, 4}, 5, 0x3000,
+                                 {cmd_register_cache_skip, 0x00, 0x30, 4}, {cmd_iqs9320_block_ks_i2c_read_multi, 0x30, 0x00, 0x30, 4},
+                                 {cmd_register_cache_static, 0x00, 0x00, 4}, {cmd_iqs9320_block_ks_i2c_read_multi, 0x30, 0x00, 0x00, 4}, 0);
+            bench_stream("iqs9320 i2c stream (period)", {cmd_iqs9320_stream_ks_i2c_read_multi, 10, 0x30, 1, 0x00, 0x10, 20},
+                         50000, expected);
+
+            // Three registers per device, returned per device
+            for (SimDevice *device : bench_devices)
+            {
+                expected_batch.insert(expected_batch.end(), &device->registers[0x1000], &device->registers[0x1000 + 20]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x1100], &device->registers[0x1100 + 4]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x2000], &device->registers[0x2000 + 8]);
+            }
+            bench_stream_rejected("iqs9320 i2c stream oversize rejected", {cmd_iqs9320_stream_ks_i2c_read_single, 20, 0, 0x30, 1,
+                                  0x00, 0x10, PACKET_LEN + 1});
+            bench_stream_rejected("iqs9320 i2c stream 11 regs rejected", {cmd_iqs9320_stream_ks_i2c_read_multi, 20, 0x30, 11,
+                                  0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10, 0, 0x10,
+                                  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1});
+            bench_stream("iqs9320 i2c stream 3 registers", {cmd_iqs9320_stream_ks_i2c_read_multi, 20, 0x30, 3,
+                         0x00, 0x10, 0x00, 0x11, 0x00, 0x20, 20, 4, 8}, 100000, expected_batch);
+
+            // Adjacent and overlapping registers, coalesced into two bursts per device
+            expected_batch.clear();
+            for (SimDevice *device : bench_devices)
+            {
+                expected_batch.insert(expected_batch.end(), &device->registers[0x1010], &device->registers[0x1010 + 6]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x1000], &device->registers[0x1000 + 10]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x1008], &device->registers[0x1008 + 4]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x1020], &device->registers[0x1020 + 2]);
+            }
+            bench_stream("iqs9320 i2c stream 4 registers burst", {cmd_iqs9320_stream_ks_i2c_read_multi, 20, 0x30, 4,
+                         0x10, 0x10, 0x00, 0x10, 0x08, 0x10, 0x20, 0x10, 6, 10, 4, 2}, 100000, expected_batch);
+            bench_stream_concurrent("iqs9320 key scan 1 ms + i2c 20 ms", {{cmd_iqs9320_stream_ks, 1, num_channels},
+                                    {cmd_iqs9320_stream_ks_i2c_read_multi, 20, 0x30, 1, 0x00, 0x10, 20}}, 100000,
+                                    {expected_ks, expected});
+        }
+        else
+        {
+            uint8_t cmd_offset = (family == bench_iqs7320a) ? 0x10 : 0x00;
+
+            // Key scan, 1 byte per device
+            for (SimDevice *device : bench_devices)
+            {
+                expected.push_back(((SimIqs7220a*)device)->key_scan_state);
+            }
+            elapsed_ns = bench_command({(uint8_t)(cmd_iqs7220a_block_ks + cmd_offset)}, response);
+            bench_report(family == bench_iqs7320a ? "iqs7320a key scan" : "iqs7220a key scan", elapsed_ns, response, expected);
+            bench_key_scan_pipelined(family == bench_iqs7320a ? "iqs7320a key scan" : "iqs7220a key scan",
+                                     {(uint8_t)(cmd_iqs7220a_block_ks + cmd_offset)}, expected);
+            bench_key_scan_calibrated(family == bench_iqs7320a ? "iqs7320a calibrated" : "iqs7220a calibrated",
+                                      {(uint8_t)(cmd_iqs7220a_block_ks + cmd_offset)}, 0, expected);
+            bench_stream(family == bench_iqs7320a ? "iqs7320a key scan stream (period)" : "iqs7220a key scan stream (period)",
+                         {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_ks : cmd_iqs7220a_stream_ks), 1}, 5000, expected);
+            bench_stream(family == bench_iqs7320a ? "iqs7320a key scan 400 us (period)" : "iqs7220a key scan 400 us (period)",
+                         {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_ks : cmd_iqs7220a_stream_ks), 1}, 5000, expected, 400);
+            bench_stream_delta(family == bench_iqs7320a ? "iqs7320a key scan delta stream (20 ms)" : "iqs7220a key scan delta stream (20 ms)",
+                               family, {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_ks : cmd_iqs7220a_stream_ks), 1}, 1);
+            expected_ks.clear();
+            for (SimDevice *device : bench_devices) expected_ks.push_back(bench_key_scan_state(family, device));
+            bench_stream_stop_scan(family == bench_iqs7320a ? "iqs7320a key scan stream stopped" : "iqs7220a key scan stream stopped",
+                                   {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_ks : cmd_iqs7220a_stream_ks), 1},
+                                   {(uint8_t)(cmd_iqs7220a_block_ks + cmd_offset)}, expected_ks);
+
+            // I2C read from every device
+            expected.clear();
+            for (SimDevice *device : bench_devices)
+            {
+                expected.insert(expected.end(), &device->registers[0x10*IQS7X20A_REGISTER_BYTES], &device->registers[0x10*IQS7X20A_REGISTER_BYTES + 20]);
+            }
+            elapsed_ns = bench_command({(uint8_t)(cmd_iqs7220a_block_i2c_read_multi + cmd_offset), 0x44, 0x10, 20}, response);
+            bench_report(family == bench_iqs7320a ? "iqs7320a i2c read multi (20 bytes)" : "iqs7220a i2c read multi (20 bytes)",
+                         elapsed_ns, response, expected);
+            bench_config_timeout(family == bench_iqs7320a ? "iqs7320a i2c ack timeout" : "iqs7220a i2c ack timeout",
+                                 {(uint8_t)(cmd_iqs7220a_block_i2c_read_single + cmd_offset), 0, 0x44, 0x10, 20});
+            bench_bus_recovery(family == bench_iqs7320a ? "iqs7320a i2c bus recovery" : "iqs7220a i2c bus recovery",
+                               {(uint8_t)(cmd_iqs7220a_block_i2c_read_single + cmd_offset), 0, 0x44, 0x10, 20},
+                               {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_multi : cmd_iqs7220a_stream_i2c_read_multi),
+                                10, 0x44, 1, 0x10, 20},
+                               std::vector<uint8_t>(expected.begin(), expected.begin() + 20));
+            bench_register_cache(family == bench_iqs7320a ? "iqs7320a cache" : "iqs7220a cache",
+                                 {(uint8_t)(cmd_iqs7220a_block_i2c_write_multi + cmd_offset), 0x44, 0x30, 4, 1, 2, 3, 4}, 4, 0x30*IQS7X20A_REGISTER_BYTES,
+                                 {cmd_register_cache_skip, 0x30, 0x00, 4}, {(uint8_t)(cmd_iqs7220a_block_i2c_read_multi + cmd_offset), 0x44, 0x30, 4},
+                                 {cmd_register_cache_static, 0x00, 0x00, 4}, {(uint8_t)(cmd_iqs7220a_block_i2c_read_multi + cmd_offset), 0x44, 0x00, 4}, 0);
+            bench_stream(family == bench_iqs7320a ? "iqs7320a i2c stream (period)" : "iqs7220a i2c stream (period)",
+                         {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_multi : cmd_iqs7220a_stream_i2c_read_multi),
+                          10, 0x44, 1, 0x10, 20}, 50000, expected);
+
+            // Three registers per device, returned per device
+            for (SimDevice *device : bench_devices)
+            {
+                expected_batch.insert(expected_batch.end(), &device->registers[0x10*IQS7X20A_REGISTER_BYTES], &device->registers[0x10*IQS7X20A_REGISTER_BYTES + 20]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x40*IQS7X20A_REGISTER_BYTES], &device->registers[0x40*IQS7X20A_REGISTER_BYTES + 4]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x80*IQS7X20A_REGISTER_BYTES], &device->registers[0x80*IQS7X20A_REGISTER_BYTES + 8]);
+            }
+            bench_stream_rejected(family == bench_iqs7320a ? "iqs7320a i2c stream oversize rejected" : "iqs7220a i2c stream oversize rejected",
+                                  {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_single : cmd_iqs7220a_stream_i2c_read_single),
+                                   20, 0, 0x44, 1, 0x10, PACKET_LEN + 1});
+            bench_stream(family == bench_iqs7320a ? "iqs7320a i2c stream 3 registers" : "iqs7220a i2c stream 3 registers",
+                         {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_multi : cmd_iqs7220a_stream_i2c_read_multi),
+                          20, 0x44, 3, 0x10, 0x40, 0x80, 20, 4, 8}, 100000, expected_batch);
+            bench_stream_batch(family == bench_iqs7320a ? "iqs7320a i2c stream batch" : "iqs7220a i2c stream batch",
+                               {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_multi : cmd_iqs7220a_stream_i2c_read_multi),
+                                20, 0x44, 3, 0x10, 0x40, 0x80, 20, 4, 8},
+                               {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_single : cmd_iqs7220a_stream_i2c_read_single),
+                                20, (uint8_t)(num_devices - 1), 0x44, 3, 0x10, 0x40, 0x80, 20, 4, 8}, expected_batch);
+
+            // Adjacent and overlapping registers, coalesced into one burst per device
+            expected_batch.clear();
+            for (SimDevice *device : bench_devices)
+            {
+                expected_batch.insert(expected_batch.end(), &device->registers[0x28*IQS7X20A_REGISTER_BYTES], &device->registers[0x28*IQS7X20A_REGISTER_BYTES + 8]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x20*IQS7X20A_REGISTER_BYTES], &device->registers[0x20*IQS7X20A_REGISTER_BYTES + 10]);
+                expected_batch.insert(expected_batch.end(), &device->registers[0x24*IQS7X20A_REGISTER_BYTES], &device->registers[0x24*IQS7X20A_REGISTER_BYTES + 4]);
+            }
+            bench_stream(family == bench_iqs7320a ? "iqs7320a i2c stream 3 registers burst" : "iqs7220a i2c stream 3 registers burst",
+                         {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_multi : cmd_iqs7220a_stream_i2c_read_multi),
+                          20, 0x44, 3, 0x28, 0x20, 0x24, 8, 10, 4}, 100000, expected_batch);
+            bench_stream_concurrent(family == bench_iqs7320a ? "iqs7320a key scan 1 ms + i2c 20 ms" : "iqs7220a key scan 1 ms + i2c 20 ms",
+                                    {{(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_ks : cmd_iqs7220a_stream_ks), 1},
+                                     {(uint8_t)((family == bench_iqs7320a) ? cmd_iqs7320a_stream_i2c_read_multi : cmd_iqs7220a_stream_i2c_read_multi),
+                                      20, 0x44, 1, 0x10, 20}}, 100000, {expected_ks, expected});
+        }
+
+        printf("%u devices, %u mismatches\n", num_devices, bench_failures);
+        return bench_failures;
+    }
+}
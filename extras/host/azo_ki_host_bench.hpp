@@ -0,0 +1,73 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_host_bench.hpp                                         *
+ * @brief       Scan and I2C timing benchmark against the simulated device    *
+ *              matrix.                                                       *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#pragma once
+
+#include "azo_ki_sim_devices.hpp"
+
+// Sketch entry points, azo_ki_arduino.ino
+void setup();
+void loop();
+#if defined(AZO_KI_DUAL_CORE)
+void setup1();
+void loop1();
+#endif
+
+namespace AZO_HOST
+{
+    /**
+    * @brief  One pass of the sketch. AZO_KI_DUAL_CORE builds run the core 0 and
+    *         core 1 loops in turn on the virtual clock.
+    */
+    inline void sketch_loop()
+    {
+        loop();
+#if defined(AZO_KI_DUAL_CORE)
+        loop1();
+#endif
+    }
+
+    enum bench_family_e
+    {
+        bench_iqs7220a,
+        bench_iqs7320a,
+        bench_iqs9320
+    };
+
+    struct bench_sample_t
+    {
+        uint8_t                 stream_id;
+        uint8_t                 command;
+        uint16_t                sequence;
+        uint32_t                timestamp;
+        std::vector<uint8_t>    data;
+    };
+
+    extern std::vector<SimDevice*> bench_devices;
+
+    void                    bench_select_pinout(bool wide);
+    void                    bench_attach_matrix(bench_family_e family, uint8_t num_columns, uint8_t num_rows, uint8_t num_channels);
+    std::vector<uint8_t>    bench_frame(const std::vector<uint8_t> &packet);
+    uint64_t                bench_command(const std::vector<uint8_t> &packet, std::vector<uint8_t> &response);
+    bool                    bench_parse_stream(const std::vector<uint8_t> &output, std::vector<bench_sample_t> &samples);
+    void                    bench_stream(const char *name, const std::vector<uint8_t> &packet, uint32_t run_us,
+                                         const std::vector<uint8_t> &expected, uint32_t interval_us = 0);
+    void                    bench_stream_concurrent(const char *name, const std::vector<std::vector<uint8_t>> &packets, uint32_t run_us,
+                                                    const std::vector<std::vector<uint8_t>> &expected);
+    uint32_t                bench_run(bench_family_e family, uint8_t num_columns, uint8_t num_rows, uint8_t num_channels);
+}
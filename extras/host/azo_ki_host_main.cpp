@@ -0,0 +1,121 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_host_main.cpp                                          *
+ * @brief       Native entry point for the host (Linux) build.                *
+ *              Runs the unchanged setup()/loop() of azo_ki_arduino.ino       *
+ *              against the simulated hardware. Raw serial input is read      *
+ *              from stdin and the serial output is written to stdout.        *
+ *              With --bench a simulated device matrix is attached and the    *
+ *              scan and I2C timing is reported instead.                      *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "azo_ki_host_bench.hpp"
+
+/**
+* @name   usage
+* @brief  Print command line options.
+*/
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "Usage: %s [options] < serial_input.bin > serial_output.bin\n"
+        "  --run-us <us>    Virtual run time in microseconds (default: until input is consumed)\n"
+        "  --bench <iqs7220a|iqs7320a|iqs9320> <columns> <rows> [channels]\n"
+        "                   Report scan and I2C timing of a simulated device matrix\n"
+        "  --pinout wide    Host only pinout of 7 x 7 IQS7x20A or 8 x 5 IQS9320 devices\n",
+        name);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t run_us = 0;
+    bool bench = false;
+    bool wide = false;
+    AZO_HOST::bench_family_e family = AZO_HOST::bench_iqs7220a;
+    uint8_t num_columns = 0, num_rows = 0, num_channels = 20;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "--run-us") == 0) && (i + 1 < argc))
+        {
+            run_us = strtoull(argv[++i], nullptr, 0);
+        }
+        else if ((strcmp(argv[i], "--pinout") == 0) && (i + 1 < argc))
+        {
+            wide = (strcmp(argv[++i], "wide") == 0);
+        }
+        else if ((strcmp(argv[i], "--bench") == 0) && (i + 3 < argc))
+        {
+            bench = true;
+            i++;
+            if (strcmp(argv[i], "iqs7320a") == 0)       family = AZO_HOST::bench_iqs7320a;
+            else if (strcmp(argv[i], "iqs9320") == 0)   family = AZO_HOST::bench_iqs9320;
+            num_columns = atoi(argv[++i]);
+            num_rows = atoi(argv[++i]);
+            if ((i + 1 < argc) && (argv[i + 1][0] != '-')) num_channels = atoi(argv[++i]);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    AZO_HOST::bench_select_pinout(wide);
+    AZO_HOST::reset();
+    setup();
+#if defined(AZO_KI_DUAL_CORE)
+    setup1();
+#endif
+
+    if (bench)
+    {
+        return AZO_HOST::bench_run(family, num_columns, num_rows, num_channels) ? 1 : 0;
+    }
+
+    // Raw serial input
+    uint8_t buffer[256];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), stdin)) > 0)
+    {
+        Serial.inject(buffer, length);
+    }
+
+    // Run until the input was consumed and the loop went idle, or for the requested virtual time
+    uint32_t idle_loops = 0;
+    while (true)
+    {
+        AZO_HOST::sketch_loop();
+        AZO_HOST::advance_ns(HOST_LOOP_NS);
+
+        if (run_us)
+        {
+            if (AZO_HOST::time_ns() >= run_us*1000) break;
+        }
+        else if (Serial.available() == 0)
+        {
+            if (++idle_loops > 1000) break;
+        }
+    }
+
+    std::vector<uint8_t> output = Serial.take_output();
+    fwrite(output.data(), 1, output.size(), stdout);
+
+    fprintf(stderr, "virtual time: %llu us, serial writes: %u, bytes: %u\n",
+        (unsigned long long)(AZO_HOST::time_ns()/1000), Serial.write_calls, Serial.bytes_written);
+
+    return 0;
+}
@@ -0,0 +1,381 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_sim_devices.cpp                                        *
+ * @brief       Behavioural models of the IQS7220A, IQS7320A and IQS9320      *
+ *              for the host build.                                           *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include "azo_ki_sim_devices.hpp"
+
+namespace AZO_HOST
+{
+    // -------------------------------------------------------------------------
+    // SimDevice
+    // -------------------------------------------------------------------------
+    SimDevice::SimDevice(uint8_t i2c_address, size_t register_space, uint8_t register_bytes)
+        : settle_ns(SIM_SETTLE_NS), ack_ns(SIM_ACK_NS), i2c_address(i2c_address),
+          i2c_enabled(false), registers(register_space*register_bytes, 0), i2c_transfers(0),
+          output_low(0), pending_low(0), pending_ns(0), register_pointer(0),
+          pointer_bytes(register_space > 0x100 ? 2 : 1), register_bytes(register_bytes), pointer_set(false)
+    {
+    }
+
+    /**
+    * @name   drive
+    * @brief  Schedule a new set of output lines pulled LOW by the device.
+    *         The previous output remains visible until at_ns.
+    */
+    void SimDevice::drive(uint32_t low, uint64_t at_ns)
+    {
+        uint64_t now_ns = time_ns();
+
+        if (now_ns >= this->pending_ns) this->output_low = this->pending_low;
+        this->pending_low = low;
+        this->pending_ns = at_ns;
+    }
+
+    uint32_t SimDevice::gpio_pull_low(uint64_t now_ns)
+    {
+        if (now_ns >= this->pending_ns) this->output_low = this->pending_low;
+        return this->output_low;
+    }
+
+    bool SimDevice::i2c_acknowledge(uint8_t address)
+    {
+        return this->i2c_enabled && (address == this->i2c_address);
+    }
+
+    void SimDevice::i2c_write(const uint8_t *data, size_t length)
+    {
+        size_t i = 0;
+
+        // Register address, LSB first, auto-increments per byte
+        this->register_pointer = 0;
+        for (; (i < length) && (i < this->pointer_bytes); i++)
+        {
+            this->register_pointer |= (uint32_t)data[i] << (8*i);
+        }
+        this->register_pointer *= this->register_bytes;
+        this->pointer_set = (i == this->pointer_bytes);
+
+        // Auto-incrementing register writes
+        for (; i < length; i++)
+        {
+            this->registers[this->register_pointer++ % this->registers.size()] = data[i];
+        }
+        this->i2c_transfers++;
+    }
+
+    size_t SimDevice::i2c_read(uint8_t *data, size_t length)
+    {
+        for (size_t i = 0; i < length; i++)
+        {
+            data[i] = this->registers[this->register_pointer++ % this->registers.size()];
+        }
+        this->i2c_transfers++;
+        return length;
+    }
+
+    void SimDevice::i2c_stop()
+    {
+    }
+
+    // -------------------------------------------------------------------------
+    // SimIqs7220a
+    // -------------------------------------------------------------------------
+    SimIqs7220a::SimIqs7220a(uint32_t s0_msk, uint32_t s1_msk, uint32_t d0_msk, uint32_t d1_msk)
+        : SimDevice(0x44, 0x100, 2), key_scan_state(0x1F), key_scans(0),
+          s0_msk(s0_msk), s1_msk(s1_msk), d0_msk(d0_msk), d1_msk(d1_msk),
+          state(st_idle), s0(true), s1(true), d1(true)
+    {
+    }
+
+    void SimIqs7220a::gpio_changed(uint32_t mcu_low, uint64_t now_ns)
+    {
+        bool new_s0 = !mcu_line_low(mcu_low, this->s0_msk);
+        bool new_s1 = !mcu_line_low(mcu_low, this->s1_msk);
+        bool new_d1 = !mcu_line_low(mcu_low, this->d1_msk);
+        uint64_t settle = now_ns + this->settle_ns;
+
+        if (this->state == st_low_power)
+        {
+            // Only an I2C wake (S1 LOW) ends the low power modes
+        }
+        else if ((new_s0 != this->s0) || (new_s1 != this->s1))
+        {
+            if ((this->state == st_ch01) && !new_s0 && !new_s1)
+            {
+                // S0 LOW is driven before S1 HIGH when moving to CH2&3
+            }
+            else if (!new_s0 && !new_s1)
+            {
+                // Device selected, reset state on D0
+                this->state = st_reset_state;
+                this->i2c_enabled = false;
+                this->drive((this->key_scan_state & 0x01) ? 0 : this->d0_msk, settle);
+            }
+            else if ((this->state == st_reset_state) && new_s0 && !new_s1)
+            {
+                // CH0 on D0, CH1 on D1
+                this->state = st_ch01;
+                this->drive(((this->key_scan_state & 0x02) ? 0 : this->d0_msk) |
+                            ((this->key_scan_state & 0x04) ? 0 : this->d1_msk), settle);
+            }
+            else if ((this->state == st_ch01) && !new_s0 && new_s1)
+            {
+                // CH2 on D0, CH3 on D1
+                this->state = st_ch23;
+                this->drive(((this->key_scan_state & 0x08) ? 0 : this->d0_msk) |
+                            ((this->key_scan_state & 0x10) ? 0 : this->d1_msk), settle);
+            }
+            else if ((this->state == st_ch23) && new_s0 && new_s1)
+            {
+                this->state = st_idle;
+                this->key_scans++;
+                this->drive(0, settle);
+            }
+            else if ((this->state == st_reset_state) && new_s0 && new_s1)
+            {
+                // Column placed in configuration state, await D1 rising edge
+                this->state = st_config_column;
+                this->drive(0, settle);
+            }
+            else if ((this->state == st_reset_state) && !new_s0 && new_s1 && this->low_power_entry(new_s0, new_s1, new_d1))
+            {
+                this->state = st_low_power;
+                this->drive(0, settle);
+            }
+            else
+            {
+                this->state = st_idle;
+                this->drive(0, settle);
+            }
+        }
+        else if ((new_d1 != this->d1) && new_s0 && new_s1)
+        {
+            if ((this->state == st_config_column) && !new_d1)
+            {
+                this->state = st_config_row;
+            }
+            else if ((this->state == st_config_row) && new_d1)
+            {
+                // Acknowledge with D0 LOW once I2C is enabled
+                this->state = st_config_active;
+                this->i2c_enabled = true;
+                this->drive(this->d0_msk, now_ns + this->ack_ns);
+            }
+            else if ((this->state == st_config_active) && !new_d1)
+            {
+                // Release D0 once I2C is disabled
+                this->state = st_idle;
+                this->i2c_enabled = false;
+                this->drive(0, settle);
+            }
+        }
+
+        this->s0 = new_s0;
+        this->s1 = new_s1;
+        this->d1 = new_d1;
+    }
+
+    // -------------------------------------------------------------------------
+    // SimIqs7320a
+    // -------------------------------------------------------------------------
+    SimIqs7320a::SimIqs7320a(uint32_t s0_msk, uint32_t s1_msk, uint32_t d0_msk, uint32_t d1_msk)
+        : SimIqs7220a(s0_msk, s1_msk, d0_msk, d1_msk), standby(false)
+    {
+    }
+
+    bool SimIqs7320a::low_power_entry(bool s0, bool s1, bool d1)
+    {
+        // S1 HIGH while S0 remains LOW, D1 LOW selects standby instead of autonomous mode
+        this->standby = !d1;
+        return true;
+    }
+
+    bool SimIqs7320a::i2c_acknowledge(uint8_t address)
+    {
+        if (this->state == st_low_power)
+        {
+            return !this->s1 && (address == this->i2c_address);
+        }
+        return SimIqs7220a::i2c_acknowledge(address);
+    }
+
+    void SimIqs7320a::i2c_write(const uint8_t *data, size_t length)
+    {
+        if (this->state == st_low_power)
+        {
+            // Wake from autonomous or standby mode
+            this->state = st_idle;
+            this->standby = false;
+            return;
+        }
+        SimIqs7220a::i2c_write(data, length);
+    }
+
+    // -------------------------------------------------------------------------
+    // SimIqs9320
+    // -------------------------------------------------------------------------
+    SimIqs9320::SimIqs9320(uint32_t c0_msk, uint32_t r0_msk, uint32_t r1_msk, uint32_t r2_msk, uint32_t r3_msk,
+                           uint8_t num_channels)
+        : SimDevice(0x30, 0x10000), key_scan_state(0x3FFFFF), num_channels(num_channels), key_scans(0),
+          standby(false), key_scan_interface(true),
+          c0_msk(c0_msk), r0_msk(r0_msk), r1_msk(r1_msk), r2_msk(r2_msk), r3_msk(r3_msk),
+          state(st_idle), scan_edges(0), c0(true), r0(true)
+    {
+    }
+
+    SimIqs9320::SimIqs9320(uint8_t i2c_address)
+        : SimDevice(i2c_address, 0x10000), key_scan_state(0), num_channels(0), key_scans(0),
+          standby(false), key_scan_interface(false),
+          c0_msk(0), r0_msk(0), r1_msk(0), r2_msk(0), r3_msk(0),
+          state(st_idle), scan_edges(0), c0(true), r0(true)
+    {
+        this->i2c_enabled = true;
+    }
+
+    bool SimIqs9320::i2c_acknowledge(uint8_t address)
+    {
+        return this->i2c_enabled && (address == this->i2c_address);
+    }
+
+    void SimIqs9320::gpio_changed(uint32_t mcu_low, uint64_t now_ns)
+    {
+        if (!this->key_scan_interface) return;
+
+        bool new_c0 = !mcu_line_low(mcu_low, this->c0_msk);
+        bool new_r0 = !mcu_line_low(mcu_low, this->r0_msk);
+        bool new_r3 = !mcu_line_low(mcu_low, this->r3_msk);
+        uint64_t settle = now_ns + this->settle_ns;
+        uint8_t key_scan_cycles = (this->num_channels + 3)/4;
+
+        if (new_c0 != this->c0)
+        {
+            if ((this->state == st_scan) && !this->standby)
+            {
+                // Every C0 edge presents the next 4 channels on R0-R3
+                uint8_t cycle = this->scan_edges++;
+                if (cycle < key_scan_cycles)
+                {
+                    uint32_t states = this->key_scan_state >> (2 + 4*cycle);
+                    this->drive(((states & 0x01) ? 0 : this->r0_msk) |
+                                ((states & 0x02) ? 0 : this->r1_msk) |
+                                ((states & 0x04) ? 0 : this->r2_msk) |
+                                ((states & 0x08) ? 0 : this->r3_msk), settle);
+                }
+                else
+                {
+                    // Final edge ends the key scan, the next edge is ignored
+                    this->state = st_idle;
+                    this->key_scans++;
+                    this->drive(0, settle);
+                }
+            }
+            else if (!new_c0)
+            {
+                if ((this->state == st_idle) && !new_r0 && new_r3)
+                {
+                    // Selected by R0 for configuration (or all rows for standby)
+                    this->state = st_config_select;
+                }
+                else if ((this->state == st_idle) && !new_r3)
+                {
+                    // Another row in the column is being configured
+                    this->state = st_deselected;
+                }
+                else if ((this->state == st_idle) && !this->standby)
+                {
+                    // Key scan start, reset state on R1 and R2
+                    this->state = st_scan;
+                    this->scan_edges = 0;
+                    this->drive(((this->key_scan_state & 0x01) ? 0 : this->r1_msk) |
+                                ((this->key_scan_state & 0x02) ? 0 : this->r2_msk), settle);
+                }
+            }
+            else
+            {
+                if (this->state == st_config_select)
+                {
+                    this->state = st_config_pending;
+                }
+                else if (this->state == st_deselected)
+                {
+                    this->state = st_idle;
+                }
+            }
+        }
+
+        if (new_r0 != this->r0)
+        {
+            if (new_r0 && (this->state == st_config_pending))
+            {
+                if (this->standby)
+                {
+                    // Standby exit sequence
+                    this->standby = false;
+                    this->state = st_idle;
+                }
+                else
+                {
+                    // Acknowledge with R1 LOW once I2C is enabled
+                    this->state = st_config_active;
+                    this->i2c_enabled = true;
+                    this->drive(this->r1_msk, now_ns + this->ack_ns);
+                }
+            }
+            else if (new_r0 && (this->state == st_config_select))
+            {
+                // R0 released while C0 is LOW enters standby
+                this->standby = true;
+                this->state = st_deselected;
+            }
+            else if (!new_r0 && (this->state == st_config_active))
+            {
+                // Release R1 once I2C is disabled
+                this->state = st_idle;
+                this->i2c_enabled = false;
+                this->drive(0, settle);
+            }
+        }
+
+        this->c0 = new_c0;
+        this->r0 = new_r0;
+    }
+
+    // -------------------------------------------------------------------------
+    // SimBusHold
+    // -------------------------------------------------------------------------
+    SimBusHold::SimBusHold(uint32_t sda_msk, uint32_t scl_msk, uint8_t pulses)
+        : pulses(pulses), sda_msk(sda_msk), scl_msk(scl_msk), scl_low(false)
+    {
+    }
+
+    void SimBusHold::gpio_changed(uint32_t mcu_low, uint64_t now_ns)
+    {
+        bool new_scl_low = (mcu_low & this->scl_msk) != 0;
+
+        (void)now_ns;
+
+        // Count SCL rising edges
+        if (this->scl_low && !new_scl_low && (this->pulses > 0)) this->pulses--;
+        this->scl_low = new_scl_low;
+    }
+
+    uint32_t SimBusHold::gpio_pull_low(uint64_t now_ns)
+    {
+        (void)now_ns;
+        return (this->pulses > 0) ? this->sda_msk : 0;
+    }
+}
@@ -0,0 +1,181 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        azo_ki_sim_devices.hpp                                        *
+ * @brief       Behavioural models of the IQS7220A, IQS7320A and IQS9320      *
+ *              for the host build. The models follow the key scan and        *
+ *              configuration handshakes on the simulated GPIO bank with      *
+ *              their response delays on the virtual clock, and contain an    *
+ *              auto-incrementing I2C register file.                          *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#pragma once
+
+#include "azo_ki_host.hpp"
+
+// Default model timing
+#define SIM_SETTLE_NS           5000
+#define SIM_ACK_NS              30000
+
+namespace AZO_HOST
+{
+    /**
+    * @brief  Common part of all device models. Output lines change a
+    *         settle time after the input edge that caused the change,
+    *         until then the previous output level is read by the MCU.
+    */
+    class SimDevice : public HostPeripheral
+    {
+        public:
+            SimDevice(uint8_t i2c_address, size_t register_space, uint8_t register_bytes = 1);
+
+            uint32_t    gpio_pull_low(uint64_t now_ns) override;
+            bool        i2c_acknowledge(uint8_t address) override;
+            void        i2c_write(const uint8_t *data, size_t length) override;
+            size_t      i2c_read(uint8_t *data, size_t length) override;
+            void        i2c_stop() override;
+
+            uint64_t                settle_ns;
+            uint64_t                ack_ns;
+            uint8_t                 i2c_address;
+            bool                    i2c_enabled;
+            std::vector<uint8_t>    registers;      // register_bytes per register address
+            uint32_t                i2c_transfers;
+
+        protected:
+            void        drive(uint32_t low, uint64_t at_ns);
+            bool        mcu_line_low(uint32_t mcu_low, uint32_t mask) { return (mcu_low & mask) != 0; }
+
+            uint32_t    output_low;
+            uint32_t    pending_low;
+            uint64_t    pending_ns;
+            uint32_t    register_pointer;
+            uint8_t     pointer_bytes;
+            uint8_t     register_bytes;
+            bool        pointer_set;
+    };
+
+    /**
+    * @brief  IQS7220A key scan interface.
+    *         Column lines S0/S1, row lines D0/D1. 16-bit registers.
+    *         key_scan_state bit 0 is the device reset line level,
+    *         bits 1-4 are the levels of CH0-CH3.
+    */
+    class SimIqs7220a : public SimDevice
+    {
+        public:
+            SimIqs7220a(uint32_t s0_msk, uint32_t s1_msk, uint32_t d0_msk, uint32_t d1_msk);
+
+            void        gpio_changed(uint32_t mcu_low, uint64_t now_ns) override;
+
+            uint8_t     key_scan_state;
+            uint32_t    key_scans;
+
+        protected:
+            enum state_e
+            {
+                st_idle,
+                st_reset_state,
+                st_ch01,
+                st_ch23,
+                st_config_column,
+                st_config_row,
+                st_config_active,
+                st_low_power
+            };
+
+            virtual bool low_power_entry(bool s0, bool s1, bool d1) { return false; }
+
+            uint32_t    s0_msk, s1_msk, d0_msk, d1_msk;
+            state_e     state;
+            bool        s0, s1, d1;
+    };
+
+    /**
+    * @brief  IQS7320A key scan interface. Same handshake as the IQS7220A
+    *         with additional autonomous and standby modes.
+    */
+    class SimIqs7320a : public SimIqs7220a
+    {
+        public:
+            SimIqs7320a(uint32_t s0_msk, uint32_t s1_msk, uint32_t d0_msk, uint32_t d1_msk);
+
+            bool        i2c_acknowledge(uint8_t address) override;
+            void        i2c_write(const uint8_t *data, size_t length) override;
+
+            bool        standby;
+
+        protected:
+            bool        low_power_entry(bool s0, bool s1, bool d1) override;
+    };
+
+    /**
+    * @brief  IQS9320 device, key scan or full-polling I2C interface.
+    *         Column line C0, row lines R0-R3.
+    *         key_scan_state bits 0-1 are the reset state levels on R1/R2,
+    *         bits 2-21 are the levels of CH0-CH19.
+    */
+    class SimIqs9320 : public SimDevice
+    {
+        public:
+            // Key scan interface
+            SimIqs9320(uint32_t c0_msk, uint32_t r0_msk, uint32_t r1_msk, uint32_t r2_msk, uint32_t r3_msk,
+                       uint8_t num_channels);
+            // Full-polling I2C interface
+            SimIqs9320(uint8_t i2c_address);
+
+            void        gpio_changed(uint32_t mcu_low, uint64_t now_ns) override;
+            bool        i2c_acknowledge(uint8_t address) override;
+
+            uint32_t    key_scan_state;
+            uint8_t     num_channels;
+            uint32_t    key_scans;
+            bool        standby;
+
+        protected:
+            enum state_e
+            {
+                st_idle,
+                st_scan,
+                st_deselected,
+                st_config_select,
+                st_config_pending,
+                st_config_active
+            };
+
+            bool        key_scan_interface;
+            uint32_t    c0_msk, r0_msk, r1_msk, r2_msk, r3_msk;
+            state_e     state;
+            uint8_t     scan_edges;
+            bool        c0, r0;
+    };
+
+    /**
+    * @brief  Device stuck in the middle of a read, it holds SDA LOW until
+    *         it has seen the given number of SCL pulses from the MCU.
+    */
+    class SimBusHold : public HostPeripheral
+    {
+        public:
+            SimBusHold(uint32_t sda_msk, uint32_t scl_msk, uint8_t pulses);
+
+            void        gpio_changed(uint32_t mcu_low, uint64_t now_ns) override;
+            uint32_t    gpio_pull_low(uint64_t now_ns) override;
+
+            uint8_t     pulses;         // SCL pulses until SDA is released
+
+        protected:
+            uint32_t    sda_msk, scl_msk;
+            bool        scl_low;
+    };
+}
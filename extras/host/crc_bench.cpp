@@ -0,0 +1,91 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        crc_bench.cpp                                                 *
+ * @brief       Host micro-benchmark of the CRC16 engines on serial frame     *
+ *              sized buffers. All engines are checked against the            *
+ *              bit-by-bit reference before timing.                           *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include <stdio.h>
+#include <chrono>
+#include "azo_ki.hpp"
+
+using namespace AZO_KEYBOARD_INTERFACE;
+
+typedef uint16_t (*crc_engine_t)(const uint8_t data[], size_t data_len);
+
+struct crc_bench_engine_t
+{
+    const char     *name;
+    crc_engine_t    engine;
+};
+
+static const crc_bench_engine_t engines[] = {
+    {"bitwise",     crc16_bitwise},
+    {"table",       crc16_table},
+    {"slice4",      crc16_slice4},
+    {"dma/fallback", crc16_dma}
+};
+
+int main()
+{
+    static const size_t lengths[] = {6, 32, 128, 133};
+    const uint32_t iterations = 200000;
+    uint8_t data[256];
+    uint32_t failures = 0;
+    volatile uint16_t sink = 0;
+
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (uint8_t)(i*151 + 7);
+    }
+
+    // Verify every engine against the reference for all lengths
+    for (const crc_bench_engine_t &engine : engines)
+    {
+        for (size_t length = 0; length <= sizeof(data); length++)
+        {
+            if (engine.engine(data, length) != crc16_bitwise(data, length))
+            {
+                printf("%s: mismatch at length %zu\n", engine.name, length);
+                failures++;
+                break;
+            }
+        }
+    }
+
+    printf("%-14s", "bytes");
+    for (size_t length : lengths) printf("%12zu", length);
+    printf("   (ns per buffer)\n");
+
+    for (const crc_bench_engine_t &engine : engines)
+    {
+        printf("%-14s", engine.name);
+        for (size_t length : lengths)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t i = 0; i < iterations; i++)
+            {
+                data[0] = (uint8_t)i;
+                sink = sink ^ engine.engine(data, length);
+            }
+            auto stop = std::chrono::steady_clock::now();
+            double ns = std::chrono::duration<double, std::nano>(stop - start).count()/iterations;
+            printf("%12.1f", ns);
+        }
+        printf("\n");
+    }
+
+    return failures ? 1 : 0;
+}
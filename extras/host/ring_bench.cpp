@@ -0,0 +1,161 @@
+/******************************************************************************
+ *                                                                            *
+ *                                Copyright by                                *
+ *                                                                            *
+ *                              Azoteq (Pty) Ltd                              *
+ *                          Republic of South Africa                          *
+ *                                                                            *
+ *                           Tel: +27(0)21 863 0033                           *
+ *                           E-mail: info@azoteq.com                          *
+ *                                                                            *
+ * ========================================================================== *
+ * @file        ring_bench.cpp                                                *
+ * @brief       Host test and micro-benchmark of the SPSC ring joining the    *
+ *              serial and engine cores. A producer and a consumer thread     *
+ *              run concurrently, every byte is checked by the consumer.      *
+ * @author      Hennie van der Westhuizen - Azoteq (Pty) Ltd                  *
+ * @version     v0.0.2                                                        *
+ * @date        2023                                                          *
+ *****************************************************************************/
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include "azo_ki_ring.hpp"
+
+using namespace AZO_KEYBOARD_INTERFACE;
+
+#define RING_BENCH_LEN          4096
+#define RING_BENCH_BYTES        (64UL*1024*1024)
+#define RING_BENCH_RECORDS      1000000UL
+
+static SpscRing<RING_BENCH_LEN> ring;
+
+/**
+* @name   pattern
+* @brief  Expected value of every byte in the stream.
+*/
+static inline uint8_t pattern(uint32_t index)
+{
+    return (uint8_t)(index*151 + (index >> 8) + 7);
+}
+
+/**
+* @name   bench_stream
+* @brief  Output ring: the producer writes variable sized chunks as far as they
+*         fit, the consumer takes contiguous chunks with peek() and consume().
+* @retval Returns the number of bytes that did not match.
+*/
+static uint32_t bench_stream()
+{
+    uint32_t errors = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([]() {
+        uint8_t chunk[256];
+        uint32_t index = 0;
+        uint32_t len = 1;
+
+        while (index < RING_BENCH_BYTES)
+        {
+            len = (len*13 + 7) % sizeof(chunk) + 1;
+            if (len > RING_BENCH_BYTES - index) len = RING_BENCH_BYTES - index;
+            for (uint32_t i = 0; i < len; i++) chunk[i] = pattern(index + i);
+
+            uint32_t written = ring.write(chunk, len);
+            while (written < len)
+            {
+                // Ring full, let the consumer run when both threads share a CPU
+                std::this_thread::yield();
+                written += ring.write(&(chunk[written]), len - written);
+            }
+            index += len;
+        }
+    });
+
+    uint32_t index = 0;
+    while (index < RING_BENCH_BYTES)
+    {
+        const uint8_t *data;
+        uint32_t len = ring.peek(&data);
+
+        if (len == 0) std::this_thread::yield();
+        for (uint32_t i = 0; i < len; i++)
+        {
+            if (data[i] != pattern(index + i)) errors++;
+        }
+        ring.consume(len);
+        index += len;
+    }
+    producer.join();
+
+    auto stop = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(stop - start).count();
+    printf("%-10s %12lu bytes   %8.1f MB/s   %u errors\n", "stream", RING_BENCH_BYTES, RING_BENCH_BYTES/s/1e6, errors);
+    return errors;
+}
+
+/**
+* @name   bench_records
+* @brief  Command ring: the producer pushes length prefixed records whole, the
+*         consumer reads the length and then the record.
+* @retval Returns the number of records that did not match.
+*/
+static uint32_t bench_records()
+{
+    uint32_t errors = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([]() {
+        uint8_t record[129];
+
+        for (uint32_t n = 0; n < RING_BENCH_RECORDS; n++)
+        {
+            uint8_t len = 2 + n % 127;
+            record[0] = len;
+            for (uint8_t i = 0; i < len; i++) record[1 + i] = pattern(n + i);
+            while (!ring.push(record, len + 1)) std::this_thread::yield();
+        }
+    });
+
+    for (uint32_t n = 0; n < RING_BENCH_RECORDS; n++)
+    {
+        uint8_t record[128];
+        uint8_t len = 0;
+
+        while (ring.available() == 0) std::this_thread::yield();
+        ring.read(&len, 1);
+
+        // A pushed record is always complete
+        if ((len > sizeof(record)) || (len != 2 + n % 127) || (ring.read(record, len) != len))
+        {
+            errors++;
+            continue;
+        }
+        for (uint8_t i = 0; i < len; i++)
+        {
+            if (record[i] != pattern(n + i))
+            {
+                errors++;
+                break;
+            }
+        }
+    }
+    producer.join();
+
+    auto stop = std::chrono::steady_clock::now();
+    double s = std::chrono::duration<double>(stop - start).count();
+    printf("%-10s %12lu records %8.1f M/s    %u errors\n", "records", RING_BENCH_RECORDS, RING_BENCH_RECORDS/s/1e6, errors);
+    return errors;
+}
+
+int main()
+{
+    uint32_t errors = 0;
+
+    errors += bench_stream();
+    errors += bench_records();
+
+    return errors ? 1 : 0;
+}
\ No newline at end of file
@@ -29,176 +29,171 @@ namespace AZO_KEYBOARD_INTERFACE
     * @retval None
     */
     void KeyboardInterface::iqs7320a_gpio_setup(){
-        uint32_t value;
-        uint32_t mask;
-        uint32_t address;
-
         for (uint8_t i = 0; i < (this->num_columns); i++)
         {
-            // Set all S0 pins as software controlled GPIO
-            mask = this->pin_settings.s0_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            *(uint32_t*)(address) = value;
-            // Enable internal pullup resistors for all S0 pins
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
-
-            // Set all S1 pins as software controlled GPIO
-            mask = this->pin_settings.s1_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            // Enable internal pullup resistors for all S1 pins
-            *(uint32_t*)(address) = value;
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
+            // Set all S0 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.s0_shift[i]);
+
+            // Set all S1 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.s1_shift[i]);
         }
 
         for (uint8_t i = 0; i < (this->num_rows); i++)
         {
-            // Set all D0 pins as software controlled GPIO
-            mask = this->pin_settings.d0_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            // Enable internal pullup resistors for all D0 pins
-            *(uint32_t*)(address) = value;
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
-
-            // Set all D1 pins as software controlled GPIO
-            mask = this->pin_settings.d1_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            // Enable internal pullup resistors for all D1 pins
-            *(uint32_t*)(address) = value;
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
-        }
-
-        this->pin_settings.s0_all = 0;
-        this->pin_settings.s1_all = 0;
-        this->pin_settings.d0_all = 0;
-        this->pin_settings.d1_all = 0;
+            // Set all D0 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.d0_shift[i]);
 
-        for (uint8_t i = 0; i < num_columns; i++)
-        {
-            this->pin_settings.s0_all |= this->pin_settings.s0_msk[i];
-            this->pin_settings.s1_all |= this->pin_settings.s1_msk[i];
+            // Set all D1 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.d1_shift[i]);
         }
 
-        for (uint8_t i = 0; i < num_rows; i++)
-        {
-            this->pin_settings.d0_all |= this->pin_settings.d0_msk[i];
-            this->pin_settings.d1_all |= this->pin_settings.d1_msk[i];
-        }
+        // Lines of the device matrix, from the tables completed with the pinout
+        this->pin_settings.s0_all = this->pin_settings.s0_upto[this->num_columns];
+        this->pin_settings.s1_all = this->pin_settings.s1_upto[this->num_columns];
+        this->pin_settings.d0_all = this->pin_settings.d0_upto[this->num_rows];
+        this->pin_settings.d1_all = this->pin_settings.d1_upto[this->num_rows];
 
         // Set all pins LOW
-        *gpio_output_clear =    this->pin_settings.s0_all |
-                                this->pin_settings.s1_all |
-                                this->pin_settings.d0_all |
-                                this->pin_settings.d1_all;
+        hal_gpio_output_clear(this->pin_settings.s0_all |
+                              this->pin_settings.s1_all |
+                              this->pin_settings.d0_all |
+                              this->pin_settings.d1_all);
 
         // Set all pins as input
-        *gpio_output_enable_clear = this->pin_settings.s0_all |
-                                    this->pin_settings.s1_all |
-                                    this->pin_settings.d0_all |
-                                    this->pin_settings.d1_all;
+        hal_gpio_output_enable_clear(this->pin_settings.s0_all |
+                                     this->pin_settings.s1_all |
+                                     this->pin_settings.d0_all |
+                                     this->pin_settings.d1_all);
     }
 
     /**
-    * @name   iqs7320a_scan_keys_column
-    * @brief  Scan channel and device states for a single column of devices
-    *         in the device matrix. Populate the iqs7320a_key_scan_results instance
-    *         of the KeyboardInterface class with the sampled results.
-    * @param  colunm_select -> The index of the column which must be sampled.
-    * @retval None
+    * @name   iqs7320a_scan_rows
+    * @brief  Execute the next phase of the key scan of a device matrix with ROWS rows.
+    *         Each phase reads the results of the previous edge and drives the
+    *         next edge, the lines must settle for the scan delay of the phase before
+    *         the next step (reset state, CH0&1, CH2&3, release).
+    *         In the pipelined scan mode the last edge of a column also starts the next column.
+    *         Populate the key_scan_planes of the KeyboardInterface
+    *         class with the sampled results.
+    *         The GPIO input is read once per phase, all rows are sampled at the same instant.
+    * @param  None
+    * @retval Returns true when all columns have been scanned.
     */
-    void KeyboardInterface::iqs7320a_scan_keys_column(uint8_t column_select){
-        // Set S0 and S1 LOW
-        *gpio_output_enable_set = this->pin_settings.s0_msk[column_select] | this->pin_settings.s1_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+    template <uint8_t ROWS>
+    bool KeyboardInterface::iqs7320a_scan_rows(){
+        uint8_t column_select = this->scan_control.column;
+        uint8_t device_index = column_select*ROWS;
+        uint32_t input, rows_d0, rows_d1;
 
-        // Read device reset state
-        for (uint8_t i = 0; i < num_rows; i++)
-        {  
-            this->iqs7320a_key_scan_results[column_select][i][0] = *gpio_input & this->pin_settings.d0_msk[i];
-        }
+        if (column_select >= this->num_columns) return true;
 
-        // Set S0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s0_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+        // Settle delay of the edge driven in this phase
+        const uint8_t *scan_delay = this->scan_delay[scan_iqs7320a];
+        uint8_t settle = scan_delay[this->scan_control.phase];
+        this->scan_control.delay_index = this->scan_control.phase;
 
-        // Read CH0&1 states
-        for (uint8_t i = 0; i < num_rows; i++)
+        switch (this->scan_control.phase)
         {
-            this->iqs7320a_key_scan_results[column_select][i][1] = *gpio_input & this->pin_settings.d0_msk[i];
-            this->iqs7320a_key_scan_results[column_select][i][2] = *gpio_input & this->pin_settings.d1_msk[i];
-        }
+            case 0:
+                // Clear previous results when the scan starts
+                if (column_select == 0)
+                {
+                    memset(this->key_scan_planes, 0, this->key_scan_num_planes*sizeof(uint64_t));
+                }
 
-        // Set S1 HIGH, S0 LOW
-        *gpio_output_enable_set = this->pin_settings.s0_msk[column_select];
-        *gpio_output_enable_clear = this->pin_settings.s1_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+                // Set S0 and S1 LOW
+                hal_gpio_output_enable_set(this->pin_settings.s0_msk[column_select] | this->pin_settings.s1_msk[column_select]);
+                break;
+
+            case 1:
+                // Read device reset state
+                input = hal_gpio_input();
+                rows_d0 = rows_sample<ROWS>(input, this->pin_settings.d0_shift);
+                this->key_scan_planes[0] |= (uint64_t)rows_d0 << device_index;
+
+                // Set S0 HIGH
+                hal_gpio_output_enable_clear(this->pin_settings.s0_msk[column_select]);
+                break;
+
+            case 2:
+                // Read CH0&1 states
+                input = hal_gpio_input();
+                rows_d0 = rows_sample<ROWS>(input, this->pin_settings.d0_shift);
+                rows_d1 = rows_sample<ROWS>(input, this->pin_settings.d1_shift);
+                this->key_scan_planes[1] |= (uint64_t)rows_d0 << device_index;
+                this->key_scan_planes[2] |= (uint64_t)rows_d1 << device_index;
+
+                // Set S1 HIGH, S0 LOW
+                hal_gpio_output_enable_set(this->pin_settings.s0_msk[column_select]);
+                hal_gpio_output_enable_clear(this->pin_settings.s1_msk[column_select]);
+                break;
+
+            case 3:
+                // Read CH2&3 states
+                input = hal_gpio_input();
+                rows_d0 = rows_sample<ROWS>(input, this->pin_settings.d0_shift);
+                rows_d1 = rows_sample<ROWS>(input, this->pin_settings.d1_shift);
+                this->key_scan_planes[3] |= (uint64_t)rows_d0 << device_index;
+                this->key_scan_planes[4] |= (uint64_t)rows_d1 << device_index;
+
+                // Set S0 HIGH
+                hal_gpio_output_enable_clear(this->pin_settings.s0_msk[column_select]);
+
+                // Pipelined: set S0 and S1 LOW of the next column on the same edge. The
+                // devices of this column release the D lines in the same settle time in
+                // which the next column presents its reset state.
+                if ((this->scan_mode == scan_pipelined) && (column_select + 1 < this->num_columns))
+                {
+                    hal_gpio_output_enable_set(this->pin_settings.s0_msk[column_select + 1] | this->pin_settings.s1_msk[column_select + 1]);
+                    if (scan_delay[0] > settle) settle = scan_delay[0];
+                    this->scan_control.phase = 0;
+                    this->scan_control.column++;
+                }
+                break;
+        }
 
-        // Read CH2&3 states
-        for (uint8_t i = 0; i < num_rows; i++)
+        // Next phase, or the next column once S0 HIGH has settled
+        if (++this->scan_control.phase > 3)
         {
-            this->iqs7320a_key_scan_results[column_select][i][3] = *gpio_input & this->pin_settings.d0_msk[i];
-            this->iqs7320a_key_scan_results[column_select][i][4] = *gpio_input & this->pin_settings.d1_msk[i];
+            this->scan_control.phase = 0;
+            this->scan_control.column++;
         }
+        this->scan_control.deadline = hal_time_us() + settle;
+        return false;
+    }
 
-        // Set S0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s0_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+    /**
+    * @name   iqs7320a_scan_step
+    * @brief  Execute the next phase of the key scan of the device matrix, in the
+    *         code generated for its number of rows. See iqs7320a_scan_rows().
+    * @param  None
+    * @retval Returns true when all columns have been scanned.
+    */
+    bool KeyboardInterface::iqs7320a_scan_step(){
+        return rows_dispatch(this->num_rows, [this](auto rows) {
+            return this->iqs7320a_scan_rows<decltype(rows)::value>();
+        });
     }
 
     /**
     * @name   iqs7320a_scan_keys_all
     * @brief  Scan channel and device states for all columns in the device
-    *         matrix. Populate the iqs7320a_key_scan_results instance
+    *         matrix. Populate the key_scan_planes
     *         of the KeyboardInterface class with the sampled results.
     *         Communicate device results over serial.
     * @param  None
     * @retval None
     */
     void KeyboardInterface::iqs7320a_scan_keys_all(){
-        uint8_t i,j,k,device_result;
-        
-        // Scan each column
-        for (i = 0; i < this->num_columns; i++)
+        // Scan each column, serial is serviced while the lines settle
+        this->scan_start(scan_iqs7320a, 0);
+        while (!this->iqs7320a_scan_step())
         {
-            this->iqs7320a_scan_keys_column(i);
+            this->settle_wait(this->scan_control.deadline);
         }
 
         // Send byte value for each device
-        for (i = 0; i < this->num_columns; i++)
-        {
-            for (j = 0; j < this->num_rows; j++)
-            {
-                device_result = 0;
-                for (k = 0; k < AZQ700_KS_OUTPUT_PARAMS; k++)
-                {
-                    device_result |= (this->iqs7320a_key_scan_results[i][j][k] << k);
-                }
-                Serial.write(device_result);
-            }
-        }
+        this->scan_output();
     }
 
     /**
@@ -209,13 +204,15 @@ namespace AZO_KEYBOARD_INTERFACE
     * @retval None
     */
     void KeyboardInterface::iqs7320a_config_enter_column(uint8_t column_select){
+        this->config_column = column_select;
+
         // Set S0 and S1 LOW
-        *gpio_output_enable_set = this->pin_settings.s0_msk[column_select] | this->pin_settings.s1_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.s0_msk[column_select] | this->pin_settings.s1_msk[column_select]);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set S0 and S1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s0_msk[column_select] | this->pin_settings.s1_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.s0_msk[column_select] | this->pin_settings.s1_msk[column_select]);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
     }
 
     /**
@@ -224,23 +221,21 @@ namespace AZO_KEYBOARD_INTERFACE
     *         the column has already been placed in the configuration state and is
     *         awaiting the D1 rising edge.
     * @param  row_select -> Index of the row which must be placed in the configuration state.
-    * @retval None
+    * @retval Returns false if the device did not acknowledge within CONFIG_ACK_TIMEOUT.
     */
-    void KeyboardInterface::iqs7320a_config_enter_row(uint8_t row_select){
+    bool KeyboardInterface::iqs7320a_config_enter_row(uint8_t row_select){
+        // I2C errors and timeouts are counted against this device
+        this->i2c_device = this->config_column*this->num_rows + row_select;
+
         // Set D1 LOW
-        *gpio_output_enable_set = this->pin_settings.d1_msk[row_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.d1_msk[row_select]);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set D1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.d1_msk[row_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.d1_msk[row_select]);
 
         // Await D0 LOW
-        for (uint8_t i = 0; i < 50; i++)
-        {
-            if (!(*gpio_input & this->pin_settings.d0_msk[row_select])) break;
-            delayMicroseconds(20);
-        }
+        return this->config_await(this->pin_settings.d0_msk[row_select], false, config_ack_timeout);
     }
 
     /**
@@ -248,23 +243,22 @@ namespace AZO_KEYBOARD_INTERFACE
     * @brief  Exit the configuration state of a single device in a column that has already
     *         been placed in the configuration state.
     * @param  row_select -> Index of the row which must exit the configuration state.
-    * @retval None
+    * @retval Returns false if the device did not release D0 within CONFIG_ACK_TIMEOUT.
     */
-    void KeyboardInterface::iqs7320a_config_exit_row(uint8_t row_select){
+    bool KeyboardInterface::iqs7320a_config_exit_row(uint8_t row_select){
+        bool released;
+
         // Set D1 LOW
-        *gpio_output_enable_set = this->pin_settings.d1_msk[row_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.d1_msk[row_select]);
 
         // Await D0 HIGH
-        for (uint8_t i = 0; i < 50; i++)
-        {
-            if (*gpio_input & this->pin_settings.d0_msk[row_select]) break;
-            delayMicroseconds(20);
-        }
+        released = this->config_await(this->pin_settings.d0_msk[row_select], true, config_release_timeout);
 
         // Set D1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.d1_msk[row_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.d1_msk[row_select]);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
+
+        return released;
     }
 
     /**
@@ -275,16 +269,16 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::iqs7320a_autonomous_enter(){
         // Set S0 and S1 LOW
-        *gpio_output_enable_set = this->pin_settings.s0_all | this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.s0_all | this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set S1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set S0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.s0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
     }
 
     /**
@@ -295,18 +289,18 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::iqs7320a_autonomous_exit(){
         // Set S1 LOW
-        *gpio_output_enable_set = this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         Wire.beginTransmission(0x44);
         Wire.write(0x00);
         Wire.endTransmission();
 
-        delayMicroseconds(500);
+        this->settle_wait(hal_time_us() + 500);
 
         // Set S1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
     }
 
     /**
@@ -317,23 +311,23 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::iqs7320a_standby_enter(){
         // Set S0 and S1 LOW
-        *gpio_output_enable_set = this->pin_settings.s0_all | this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.s0_all | this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set D1 LOW
-        *gpio_output_enable_set = this->pin_settings.d1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.d1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set S1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set S0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.s0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // Set D1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.d1_all;
+        hal_gpio_output_enable_clear(this->pin_settings.d1_all);
     }
 
     /**
@@ -344,18 +338,18 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::iqs7320a_standby_exit(){
         // Set S1 LOW
-        *gpio_output_enable_set = this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         Wire.beginTransmission(0x44);
         Wire.write(0x00);
         Wire.endTransmission();
 
-        delayMicroseconds(500);
+        this->settle_wait(hal_time_us() + 500);
 
         // Set S1 HIGH
-        *gpio_output_enable_clear = this->pin_settings.s1_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.s1_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
     }
 
     /**
@@ -363,34 +357,47 @@ namespace AZO_KEYBOARD_INTERFACE
     * @brief  I2C read operation on a single device in the device matrix.
     *         Parameters are defined in the do_command() function in the azo_ki_main.cpp file.
     *         Serial response containing I2C data.
+    *         Static registers are served from the register cache.
     * @param  None
     * @retval None
     */
     void KeyboardInterface::iqs7320a_i2c_read_single(){
-        // Enable I2C on IQS device
-        this->iqs7320a_config_enter_column(this->get_device_column(this->i2c_control.device_select));
-        this->iqs7320a_config_enter_row(this->get_device_row(this->i2c_control.device_select));
+        // Static registers are served from the register cache
+        if (!this->cache_read_hit(this->i2c_control.device_select, this->i2c_control.register_addr_lsb,
+                                  this->i2c_control.input_data, this->i2c_control.data_len))
+        {
+            this->i2c_control.input_index = 0;
 
-        this->i2c_control.input_index = 0;
+            // Enable I2C on IQS device, zeros are returned if it does not acknowledge
+            this->iqs7320a_config_enter_column(this->get_device_column(this->i2c_control.device_select));
+            if (this->iqs7320a_config_enter_row(this->get_device_row(this->i2c_control.device_select)))
+            {
+                // Transmit I2C register that must be read from
+                Wire.beginTransmission(this->i2c_control.device_addr);
+                Wire.write(this->i2c_control.register_addr_lsb);
+                this->i2c_end(false);
 
-        // Transmit I2C register that must be read from
-        Wire.beginTransmission(this->i2c_control.device_addr);
-        Wire.write(this->i2c_control.register_addr_lsb);
-        Wire.endTransmission(false);
+                // Receive I2C data
+                this->i2c_request(this->i2c_control.device_addr, this->i2c_control.data_len);
+                while (Wire.available())
+                {
+                    this->i2c_control.input_data[this->i2c_control.input_index] = Wire.read();
+                    this->i2c_control.input_index++;
+                    if (this->i2c_control.input_index >= this->i2c_control.data_len) break;
+                }
+            }
 
-        // Receive I2C data
-        Wire.requestFrom(this->i2c_control.device_addr, this->i2c_control.data_len);
-        while (Wire.available())
-        {
-            this->i2c_control.input_data[this->i2c_control.input_index] = Wire.read();
-            this->i2c_control.input_index++;
-            if (this->i2c_control.input_index >= this->i2c_control.data_len) break;
-        }
+            // Disable I2C on IQS device
+            this->iqs7320a_config_exit_row(get_device_row(this->i2c_control.device_select));
 
-        // Disable I2C on IQS device
-        this->iqs7320a_config_exit_row(get_device_row(this->i2c_control.device_select));
+            if (this->i2c_control.input_index == this->i2c_control.data_len)
+            {
+                this->cache_store_read(this->i2c_control.device_select, this->i2c_control.register_addr_lsb,
+                                       this->i2c_control.input_data, this->i2c_control.data_len);
+            }
+        }
 
-        Serial.write(this->i2c_control.input_data, this->i2c_control.data_len);
+        this->output_write(this->i2c_control.input_data, this->i2c_control.data_len);
         memset(this->i2c_control.input_data, 0, this->i2c_control.data_len);
     }
 
@@ -398,19 +405,29 @@ namespace AZO_KEYBOARD_INTERFACE
     * @name   iqs7320a_i2c_write_single
     * @brief  I2C write operation to a single device in the device matrix.
     *         Parameters are defined in the do_command() function in the azo_ki_main.cpp file.
+    *         A write within a skip range is skipped when the register cache shows the device holds the data.
     * @param  None
     * @retval None
     */
     void KeyboardInterface::iqs7320a_i2c_write_single(){
-        // Enable I2C on IQS device
-        this->iqs7320a_config_enter_column(this->get_device_column(this->i2c_control.device_select));
-        this->iqs7320a_config_enter_row(this->get_device_row(this->i2c_control.device_select));
+        // Skip the write when the device already holds the data
+        if (this->cache_write_hit(this->i2c_control.device_select, this->i2c_control.register_addr_lsb,
+                                  this->i2c_control.output_data, this->i2c_control.data_len)) return;
 
-        // I2C Comms
-        Wire.beginTransmission(this->i2c_control.device_addr);
-        Wire.write(this->i2c_control.register_addr_lsb);
-        Wire.write(this->i2c_control.output_data, this->i2c_control.data_len);
-        Wire.endTransmission(true);
+        // Enable I2C on IQS device, the write is skipped if it does not acknowledge
+        this->iqs7320a_config_enter_column(this->get_device_column(this->i2c_control.device_select));
+        if (this->iqs7320a_config_enter_row(this->get_device_row(this->i2c_control.device_select)))
+        {
+            // I2C Comms
+            Wire.beginTransmission(this->i2c_control.device_addr);
+            Wire.write(this->i2c_control.register_addr_lsb);
+            Wire.write(this->i2c_control.output_data, this->i2c_control.data_len);
+            if (this->i2c_end(true))
+            {
+                this->cache_store_write(this->i2c_control.device_select, this->i2c_control.register_addr_lsb,
+                                        this->i2c_control.output_data, this->i2c_control.data_len);
+            }
+        }
 
         // Disable I2C on IQS device
         this->iqs7320a_config_exit_row(get_device_row(this->i2c_control.device_select));
@@ -420,34 +437,108 @@ namespace AZO_KEYBOARD_INTERFACE
     * @name   iqs7320a_i2c_read_multi
     * @brief  I2C read operation on all devices in the device matrix.
     *         Parameters are defined in the do_command function in the azo_ki_main.cpp file.
+    *         Static registers are served from the register cache.
     * @param  None
     * @retval None
     */
     void KeyboardInterface::iqs7320a_i2c_read_multi(){
+        bool released = true;   // Cleared when a device does not exit the configuration state
+
         for (uint8_t i = 0; i < this->num_columns; i++)
         {
-            this->iqs7320a_config_enter_column(i);
+            bool column_entered = false;
+
             for (uint8_t j = 0; j < this->num_rows; j++)
             {
-                this->iqs7320a_config_enter_row(j);
+                uint8_t device_index = i*this->num_rows + j;
+
+                // Static registers are served from the register cache
+                if (this->cache_read_hit(device_index, this->i2c_control.register_addr_lsb,
+                                         this->i2c_control.input_data, this->i2c_control.data_len))
+                {
+                    this->output_write(this->i2c_control.input_data, this->i2c_control.data_len);
+                    memset(this->i2c_control.input_data, 0, this->i2c_control.data_len);
+                    continue;
+                }
+
+                // A device still in the configuration state shares the I2C address,
+                // no further device is addressed and zeros are returned
+                if (!released)
+                {
+                    this->output_zeros(this->i2c_control.data_len);
+                    continue;
+                }
+
+                if (!column_entered)
+                {
+                    this->iqs7320a_config_enter_column(i);
+                    column_entered = true;
+                }
 
                 this->i2c_control.input_index = 0;
-                // Transmit I2C register that must be read from
-                Wire.beginTransmission(this->i2c_control.device_addr);
-                Wire.write(this->i2c_control.register_addr_lsb);
-                Wire.endTransmission(false);
-                // Receive I2C data
-                Wire.requestFrom(this->i2c_control.device_addr, this->i2c_control.data_len);
-                while (Wire.available())
+                if (this->iqs7320a_config_enter_row(j))
                 {
-                    this->i2c_control.input_data[this->i2c_control.input_index] = Wire.read();
-                    this->i2c_control.input_index++;
-                    if (this->i2c_control.input_index >= this->i2c_control.data_len) break;
+                    // Transmit I2C register that must be read from
+                    Wire.beginTransmission(this->i2c_control.device_addr);
+                    Wire.write(this->i2c_control.register_addr_lsb);
+                    this->i2c_end(false);
+                    // Receive I2C data
+                    this->i2c_request(this->i2c_control.device_addr, this->i2c_control.data_len);
+                    while (Wire.available())
+                    {
+                        this->i2c_control.input_data[this->i2c_control.input_index] = Wire.read();
+                        this->i2c_control.input_index++;
+                        if (this->i2c_control.input_index >= this->i2c_control.data_len) break;
+                    }
                 }
 
-                Serial.write(this->i2c_control.input_data, this->i2c_control.data_len);
+                if (this->i2c_control.input_index == this->i2c_control.data_len)
+                {
+                    this->cache_store_read(device_index, this->i2c_control.register_addr_lsb,
+                                           this->i2c_control.input_data, this->i2c_control.data_len);
+                }
+
+                this->output_write(this->i2c_control.input_data, this->i2c_control.data_len);
                 memset(this->i2c_control.input_data, 0, this->i2c_control.data_len);
-                this->iqs7320a_config_exit_row(get_device_row(j));
+                released = this->iqs7320a_config_exit_row(get_device_row(j));
+            }
+        }
+    }
+
+    /**
+    * @name   iqs7320a_i2c_read_batch
+    * @brief  Read the registers of a stream from the selected device, or from every device
+    *         in the device matrix when device_select is 0xFF. Each device is placed in the
+    *         configuration state once and all registers are read back to back.
+    *         The data is returned per device, in register order.
+    * @param  stream -> Stream with the registers to read
+    * @retval None
+    */
+    void KeyboardInterface::iqs7320a_i2c_read_batch(const stream_control_t *stream){
+        uint8_t device_select = this->i2c_control.device_select;
+        bool released = true;   // Cleared when a device does not exit the configuration state
+
+        for (uint8_t i = 0; i < this->num_columns; i++)
+        {
+            if ((device_select != 0xFF) && (i != this->get_device_column(device_select))) continue;
+
+            if (released) this->iqs7320a_config_enter_column(i);
+            for (uint8_t j = 0; j < this->num_rows; j++)
+            {
+                if ((device_select != 0xFF) && (j != this->get_device_row(device_select))) continue;
+
+                // Zeros are returned for a device that does not acknowledge, and for all
+                // devices after one that did not exit the configuration state
+                if (!released)
+                {
+                    this->stream_skip_registers(stream);
+                    continue;
+                }
+                if (this->iqs7320a_config_enter_row(j))
+                    this->stream_read_registers(stream, 1);
+                else
+                    this->stream_skip_registers(stream);
+                released = this->iqs7320a_config_exit_row(j);
             }
         }
     }
@@ -456,24 +547,46 @@ namespace AZO_KEYBOARD_INTERFACE
     * @name   iqs7320a_config_enter_column
     * @brief  I2C write operation to all devices in the device matrix.
     *         Parameters are defined in the do_command() function in the azo_ki_main.cpp file.
+    *         Within a skip range, devices which the register cache shows to hold the data are skipped.
     * @param  None
     * @retval None
     */
     void KeyboardInterface::iqs7320a_i2c_write_multi(){
         for (uint8_t i = 0; i < this->num_columns; i++)
         {
-            this->iqs7220a_config_enter_column(i);
+            bool column_entered = false;
+
             for (uint8_t j = 0; j < this->num_rows; j++)
             {
-                this->iqs7220a_config_enter_row(j);
+                uint8_t device_index = i*this->num_rows + j;
 
-                // I2C Comms
-                Wire.beginTransmission(this->i2c_control.device_addr);
-                Wire.write(this->i2c_control.register_addr_lsb);
-                Wire.write(this->i2c_control.output_data, this->i2c_control.data_len);
-                Wire.endTransmission(true);
+                // Skip the devices which already hold the data
+                if (this->cache_write_hit(device_index, this->i2c_control.register_addr_lsb,
+                                          this->i2c_control.output_data, this->i2c_control.data_len)) continue;
+
+                if (!column_entered)
+                {
+                    this->iqs7220a_config_enter_column(i);
+                    column_entered = true;
+                }
+
+                // The write is skipped for a device that does not acknowledge
+                if (this->iqs7220a_config_enter_row(j))
+                {
+                    // I2C Comms
+                    Wire.beginTransmission(this->i2c_control.device_addr);
+                    Wire.write(this->i2c_control.register_addr_lsb);
+                    Wire.write(this->i2c_control.output_data, this->i2c_control.data_len);
+                    if (this->i2c_end(true))
+                    {
+                        this->cache_store_write(device_index, this->i2c_control.register_addr_lsb,
+                                                this->i2c_control.output_data, this->i2c_control.data_len);
+                    }
+                }
 
-                this->iqs7220a_config_exit_row(j);
+                // A device still in the configuration state shares the I2C address,
+                // no further device is addressed
+                if (!this->iqs7220a_config_exit_row(j)) return;
             }
         }
     }
@@ -29,197 +29,194 @@ namespace AZO_KEYBOARD_INTERFACE
     * @retval None
     */
     void KeyboardInterface::iqs9320_gpio_setup(){
-         uint32_t value;
-        uint32_t mask;
-        uint32_t address;
-
         for (uint8_t i = 0; i < (this->num_columns); i++)
         {
-            // Set all C0 pins as software controlled GPIO
-            mask = this->pin_settings.c0_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            *(uint32_t*)(address) = value;
-            // Enable internal pullup resistors for all C0 pins
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
+            // Set all C0 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.c0_shift[i]);
         }
 
         for (uint8_t i = 0; i < (this->num_rows); i++)
         {
-            // Set all R0 pins as software controlled GPIO
-            mask = this->pin_settings.r0_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            // Enable internal pullup resistors for all R0 pins
-            *(uint32_t*)(address) = value;
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
-
-            // Set all R1 pins as software controlled GPIO
-            mask = this->pin_settings.r1_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            // Enable internal pullup resistors for all R1 pins
-            *(uint32_t*)(address) = value;
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
-
-            // Set all R2 pins as software controlled GPIO
-            mask = this->pin_settings.r2_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            // Enable internal pullup resistors for all R2 pins
-            *(uint32_t*)(address) = value;
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
-
-            // Set all R3 pins as software controlled GPIO
-            mask = this->pin_settings.r3_msk[i];
-            address = 0x40014004 + log2(mask)*8;
-            value = *(uint32_t*)(address);
-            value &= 0xFFFFFFE0;
-            value |= 5;
-            // Enable internal pullup resistors for all R3 pins
-            *(uint32_t*)(address) = value;
-            address = 0x4001C004 + log2(mask)*4;
-            value = *(uint32_t*)(address);
-            value |= (1 << 3);
-            *(uint32_t*)(address) = value;
-        }
+            // Set all R0 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.r0_shift[i]);
 
-        this->pin_settings.c0_all = 0;
-        this->pin_settings.r0_all = 0;
-        this->pin_settings.r1_all = 0;
-        this->pin_settings.r2_all = 0;
-        this->pin_settings.r3_all = 0;
-        
-        for (uint8_t i = 0; i < num_columns; i++)
-        {
-            this->pin_settings.c0_all |= this->pin_settings.c0_msk[i];
-            
-        }
+            // Set all R1 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.r1_shift[i]);
 
-        for (uint8_t i = 0; i < num_rows; i++)
-        {
-            this->pin_settings.r0_all |= this->pin_settings.r0_msk[i];
-            this->pin_settings.r1_all |= this->pin_settings.r1_msk[i];
-            this->pin_settings.r2_all |= this->pin_settings.r2_msk[i];
-            this->pin_settings.r3_all |= this->pin_settings.r3_msk[i];
+            // Set all R2 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.r2_shift[i]);
+
+            // Set all R3 pins as software controlled GPIO with internal pullup enabled
+            hal_gpio_pad_setup(this->pin_settings.r3_shift[i]);
         }
 
+        // Lines of the device matrix, from the tables completed with the pinout
+        this->pin_settings.c0_all = this->pin_settings.c0_upto[this->num_columns];
+        this->pin_settings.r0_all = this->pin_settings.r0_upto[this->num_rows];
+        this->pin_settings.r1_all = this->pin_settings.r1_upto[this->num_rows];
+        this->pin_settings.r2_all = this->pin_settings.r2_upto[this->num_rows];
+        this->pin_settings.r3_all = this->pin_settings.r3_upto[this->num_rows];
+
         // Set all pins LOW
-        *gpio_output_clear =    this->pin_settings.c0_all |
-                                this->pin_settings.r0_all |
-                                this->pin_settings.r1_all |
-                                this->pin_settings.r2_all |
-                                this->pin_settings.r3_all;
+        hal_gpio_output_clear(this->pin_settings.c0_all |
+                              this->pin_settings.r0_all |
+                              this->pin_settings.r1_all |
+                              this->pin_settings.r2_all |
+                              this->pin_settings.r3_all);
 
         // Set all pins as input
-        *gpio_output_enable_clear = this->pin_settings.c0_all |
-                                    this->pin_settings.r0_all |
-                                    this->pin_settings.r1_all |
-                                    this->pin_settings.r2_all |
-                                    this->pin_settings.r3_all;
+        hal_gpio_output_enable_clear(this->pin_settings.c0_all |
+                                     this->pin_settings.r0_all |
+                                     this->pin_settings.r1_all |
+                                     this->pin_settings.r2_all |
+                                     this->pin_settings.r3_all);
 
     }
 
     /**
-    * @name   iqs9320_scan_keys_column
-    * @brief  Scan channel and device states for a single column of devices
-    *         in the device matrix. Populate the iqs7320a_key_scan_results instance
-    *         of the KeyboardInterface class with the sampled results.
+    * @name   iqs9320_scan_rows
+    * @brief  Execute the next phase of the key scan of a device matrix with ROWS rows.
+    *         Each phase reads the results of the previous C0 edge and drives the
+    *         next edge, the lines must settle for the scan delay of the phase before
+    *         the next step (reset state, channel cycle, release).
+    *         In the pipelined scan mode the final edge of a column also starts the next column.
+    *         Populate the key_scan_planes of the KeyboardInterface
+    *         class with the sampled results.
     *         The IQS9320 can produce different number of GPIO responses defined by the
-    *         number of channels the device is configured for. 
-    * @param  colunm_select -> The index of the column which must be sampled.
-    * @param  num_channels  -> The number of channels the device is configured for.
-    * @retval None
+    *         number of channels the device is configured for (scan_control.num_channels).
+    *         The GPIO input is read once per phase, all rows are sampled at the same instant.
+    * @param  None
+    * @retval Returns true when all columns have been scanned.
     */
-    void KeyboardInterface::iqs9320_scan_keys_column(uint8_t column_select, uint8_t num_channels){
-        // Set C0 LOW
-        *gpio_output_enable_set = this->pin_settings.c0_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+    template <uint8_t ROWS>
+    bool KeyboardInterface::iqs9320_scan_rows(){
+        uint8_t column_select = this->scan_control.column;
+        uint8_t device_index = column_select*ROWS;
+        uint8_t key_scan_cycles = this->scan_control.num_channels/4;
+        uint32_t input, rows[4];
 
-        // Read device reset state
-        for (uint8_t i = 0; i < this->num_rows; i++)
-        {
-            iqs9320_key_scan_results[column_select][i][0] = *gpio_input & this->pin_settings.r1_msk[i]; // True when LOW
-            iqs9320_key_scan_results[column_select][i][1] = *gpio_input & this->pin_settings.r2_msk[i]; // True when LOW
-        }
+        key_scan_cycles += (this->scan_control.num_channels%4) ? 1 : 0;
+
+        if (column_select >= this->num_columns) return true;
 
-        uint8_t key_scan_cycles = num_channels/4;
-        key_scan_cycles += (num_channels%4) ? 1 : 0;
-        bool c0_state = 0;
+        // Settle delay of the edge driven in this phase (reset state, channel cycle, release)
+        const uint8_t *scan_delay = this->scan_delay[scan_iqs9320];
 
-        for (uint8_t i = 0; i < key_scan_cycles; i++)
+        switch (this->scan_control.phase)
         {
-            if (c0_state)
-            {
+            case 0:
+                // Clear previous results when the scan starts
+                if (column_select == 0)
+                {
+                    memset(this->key_scan_planes, 0, this->key_scan_num_planes*sizeof(uint64_t));
+                }
+
                 // Set C0 LOW
-                *gpio_output_enable_set = this->pin_settings.c0_msk[column_select];
-                c0_state = 0;
-            }
-            else
-            {
-                // Set C0 HIGH
-                *gpio_output_enable_clear = this->pin_settings.c0_msk[column_select];
-                c0_state = 1;
-            }
+                hal_gpio_output_enable_set(this->pin_settings.c0_msk[column_select]);
+                this->scan_control.c0_state = 0;
+                this->scan_control.cycle = 0;
+                this->scan_control.phase = 1;
+                this->scan_control.delay_index = 0;
+                break;
+
+            case 1:
+                // Read device reset state
+                input = hal_gpio_input();
+                rows[1] = rows_sample<ROWS>(input, this->pin_settings.r1_shift); // True when LOW
+                rows[2] = rows_sample<ROWS>(input, this->pin_settings.r2_shift); // True when LOW
+                this->key_scan_planes[0] |= (uint64_t)rows[1] << device_index;
+                this->key_scan_planes[1] |= (uint64_t)rows[2] << device_index;
+
+                // Set C0 HIGH, also for the previous column when its final edge left C0 LOW
+                hal_gpio_output_enable_clear(this->pin_settings.c0_msk[column_select] | this->scan_control.c0_release);
+                this->scan_control.c0_release = 0;
+                this->scan_control.c0_state = 1;
+                this->scan_control.phase = (key_scan_cycles > 0) ? 2 : 3;
+                this->scan_control.delay_index = (key_scan_cycles > 0) ? 1 : 2;
+                break;
+
+            case 2:
+                {
+                    uint8_t i = this->scan_control.cycle++;
+
+                    // Read CH0, CH1, CH2, CH3 of this cycle
+                    input = hal_gpio_input();
+                    rows[0] = rows_sample<ROWS>(input, this->pin_settings.r0_shift);
+                    rows[1] = rows_sample<ROWS>(input, this->pin_settings.r1_shift);
+                    rows[2] = rows_sample<ROWS>(input, this->pin_settings.r2_shift);
+                    rows[3] = rows_sample<ROWS>(input, this->pin_settings.r3_shift);
+                    this->key_scan_planes[2 + i*4] |= (uint64_t)rows[0] << device_index;
+                    this->key_scan_planes[3 + i*4] |= (uint64_t)rows[1] << device_index;
+                    this->key_scan_planes[4 + i*4] |= (uint64_t)rows[2] << device_index;
+                    this->key_scan_planes[5 + i*4] |= (uint64_t)rows[3] << device_index;
+
+                    // Toggle C0 for the next cycle, or for the final edge that ends the key scan
+                    if (this->scan_control.c0_state)
+                    {
+                        hal_gpio_output_enable_set(this->pin_settings.c0_msk[column_select]);
+                        this->scan_control.c0_state = 0;
+                    }
+                    else
+                    {
+                        hal_gpio_output_enable_clear(this->pin_settings.c0_msk[column_select]);
+                        this->scan_control.c0_state = 1;
+                    }
+                    this->scan_control.delay_index = 1;
+                    if (this->scan_control.cycle < key_scan_cycles) break;
+                    this->scan_control.phase = 3;
+                    this->scan_control.delay_index = 2;
+
+                    // Pipelined: set C0 LOW of the next column on the final edge. The devices
+                    // of this column release the R lines in the same settle time in which the
+                    // next column presents its reset state. The final edge ends the key scan,
+                    // a C0 left LOW is set HIGH on the next edge.
+                    if ((this->scan_mode == scan_pipelined) && (column_select + 1 < this->num_columns))
+                    {
+                        hal_gpio_output_enable_set(this->pin_settings.c0_msk[column_select + 1]);
+                        this->scan_control.c0_release = this->scan_control.c0_state ? 0 : this->pin_settings.c0_msk[column_select];
+                        this->scan_control.c0_state = 0;
+                        this->scan_control.cycle = 0;
+                        this->scan_control.phase = 1;
+                        this->scan_control.column++;
+                        if (scan_delay[0] > scan_delay[2]) this->scan_control.delay_index = 0;
+                    }
+                    break;
+                }
 
-            delayMicroseconds(SCAN_DELAY);
+            case 3:
+                // Leave C0 HIGH before the next column, no settle required if it already is
+                this->scan_control.phase = 0;
+                this->scan_control.column++;
+                if (this->scan_control.c0_state) return (this->scan_control.column >= this->num_columns);
 
-            // Read CH0, CH1, CH2
-            for (uint8_t j = 0; j < this->num_rows; j++)
-            {
-                this->iqs9320_key_scan_results[column_select][j][2 + i*4] = *gpio_input & this->pin_settings.r0_msk[j];
-                this->iqs9320_key_scan_results[column_select][j][3 + i*4] = *gpio_input & this->pin_settings.r1_msk[j];
-                this->iqs9320_key_scan_results[column_select][j][4 + i*4] = *gpio_input & this->pin_settings.r2_msk[j];
-                this->iqs9320_key_scan_results[column_select][j][5 + i*4] = *gpio_input & this->pin_settings.r3_msk[j];
-            }
+                // Set C0 HIGH
+                hal_gpio_output_enable_clear(this->pin_settings.c0_msk[column_select]);
+                this->scan_control.c0_state = 1;
+                this->scan_control.delay_index = 2;
+                break;
         }
 
-        if (c0_state)
-        {
-            // Set C0 LOW
-            *gpio_output_enable_set = this->pin_settings.c0_msk[column_select];
-            c0_state = 0;
-        }
-        else
-        {
-            // Set C0 HIGH
-            *gpio_output_enable_clear = this->pin_settings.c0_msk[column_select];
-            c0_state = 1;
-        }
-        delayMicroseconds(SCAN_DELAY);
+        this->scan_control.deadline = hal_time_us() + scan_delay[this->scan_control.delay_index];
+        return false;
+    }
 
-        if (!c0_state)
-        {
-            // Set C0 HIGH
-            *gpio_output_enable_clear = this->pin_settings.c0_msk[column_select];
-            delayMicroseconds(SCAN_DELAY);
-        }
+    /**
+    * @name   iqs9320_scan_step
+    * @brief  Execute the next phase of the key scan of the device matrix, in the
+    *         code generated for its number of rows. See iqs9320_scan_rows().
+    * @param  None
+    * @retval Returns true when all columns have been scanned.
+    */
+    bool KeyboardInterface::iqs9320_scan_step(){
+        return rows_dispatch(this->num_rows, [this](auto rows) {
+            return this->iqs9320_scan_rows<decltype(rows)::value>();
+        });
     }
 
     /**
     * @name   iqs9320_scan_keys_all
     * @brief  Scan channel and device states for all columns in the device
-    *         matrix. Populate the iqs7320a_key_scan_results instance
+    *         matrix. Populate the key_scan_planes
     *         of the KeyboardInterface class with the sampled results.
     *         Communicate device results over serial.
     *         The IQS9320 can produce different number of GPIO responses 
@@ -228,28 +225,15 @@ namespace AZO_KEYBOARD_INTERFACE
     * @retval None
     */
     void KeyboardInterface::iqs9320_scan_keys_all(uint8_t num_channels){
-         uint8_t i,j,k;
-        uint32_t device_result;
-        // Scan all keys
-        for (i = 0; i < this->num_columns; i++)
+        // Scan all keys, serial is serviced while the lines settle
+        this->scan_start(scan_iqs9320, num_channels);
+        while (!this->iqs9320_scan_step())
         {
-            this->iqs9320_scan_keys_column(i, num_channels);
-        }
-        // Send byte value for each device
-        for (i = 0; i < this->num_columns; i++)
-        {
-            for (j = 0; j < this->num_rows; j++)
-            {
-                device_result = 0;
-                for (k = 0; k < (2+num_channels); k++)
-                {
-                    device_result |= (this->iqs9320_key_scan_results[i][j][k] << k);
-                }
-                Serial.write(device_result & 0xFF);
-                Serial.write((device_result & 0xFF00) >> 8);
-                Serial.write((device_result & 0xFF0000) >> 16);
-            }
+            this->settle_wait(this->scan_control.deadline);
         }
+
+        // Send 3 byte value for each device
+        this->scan_output();
     }
 
     /**
@@ -259,33 +243,31 @@ namespace AZO_KEYBOARD_INTERFACE
     *                          the configuration mode.
     * @param  row_select    -> Index of the row in which the device is that must be placed in the
     *                          configuration state.
-    * @retval None
+    * @retval Returns false if the device did not acknowledge within CONFIG_ACK_TIMEOUT.
     */
-    void KeyboardInterface::iqs9320_config_enter(uint8_t column_select, uint8_t row_select){
+    bool KeyboardInterface::iqs9320_config_enter(uint8_t column_select, uint8_t row_select){
+        // I2C errors and timeouts are counted against this device
+        this->i2c_device = column_select*this->num_rows + row_select;
+
         // R0 LOW for selected row
-        *gpio_output_enable_set = this->pin_settings.r0_msk[row_select];
+        hal_gpio_output_enable_set(this->pin_settings.r0_msk[row_select]);
 
         // R3 LOW for all other rows
-        *gpio_output_enable_set = this->pin_settings.r3_all & ~(this->pin_settings.r3_msk[row_select]);
+        hal_gpio_output_enable_set(this->pin_settings.r3_all & ~(this->pin_settings.r3_msk[row_select]));
 
         // C0 LOW
-        *gpio_output_enable_set = this->pin_settings.c0_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.c0_msk[column_select]);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // C0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.c0_msk[column_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.c0_msk[column_select]);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // R0 HIGH & R3 HIGH for all rows
-        *gpio_output_enable_clear = this->pin_settings.r0_all | this->pin_settings.r3_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.r0_all | this->pin_settings.r3_all);
 
-        // Await R1 Falling Edge (1ms timeout)
-        for (uint8_t i = 0; i < 50; i++)
-        {
-            if ((*gpio_input & this->pin_settings.r1_msk[row_select]) == 0) break;
-            delayMicroseconds(20);
-        }
+        // Await R1 Falling Edge
+        return this->config_await(this->pin_settings.r1_msk[row_select], false, config_ack_timeout);
     }
 
     /**
@@ -293,22 +275,21 @@ namespace AZO_KEYBOARD_INTERFACE
     * @brief  Exit the configuration state for a single device in the matrix.
     *         Only the row index is required to exit the configuration state of the device.
     * @param  row_select -> The row index of the device which must exit the configuration state.
-    * @retval None
+    * @retval Returns false if the device did not release R1 within CONFIG_ACK_TIMEOUT.
     */
-    void KeyboardInterface::iqs9320_config_exit(uint8_t row_select){
+    bool KeyboardInterface::iqs9320_config_exit(uint8_t row_select){
+        bool released;
+
         // R0 LOW
-        *gpio_output_enable_set = this->pin_settings.r0_msk[row_select];
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.r0_msk[row_select]);
 
-        // Await R1 Rising Edge (1ms timeout)
-        for (uint8_t i = 0; i < 50; i++)
-        {
-            if ((*gpio_input & this->pin_settings.r1_msk[row_select]) != 0) break;
-            delayMicroseconds(20);
-        }
+        // Await R1 Rising Edge
+        released = this->config_await(this->pin_settings.r1_msk[row_select], true, config_release_timeout);
 
         // R0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.r0_msk[row_select];
+        hal_gpio_output_enable_clear(this->pin_settings.r0_msk[row_select]);
+
+        return released;
     }
 
     /**
@@ -319,20 +300,20 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::iqs9320_standby_enter(){
         // R0 LOW
-        *gpio_output_enable_set = this->pin_settings.r0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.r0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // C0 LOW
-        *gpio_output_enable_set = this->pin_settings.c0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.c0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // R0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.r0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.r0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // C0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.c0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.c0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
     }
 
     /**
@@ -343,20 +324,20 @@ namespace AZO_KEYBOARD_INTERFACE
     */
     void KeyboardInterface::iqs9320_standby_exit(){
         // R0 LOW
-        *gpio_output_enable_set = this->pin_settings.r0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_set(this->pin_settings.r0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // C0 LOW
-        *gpio_output_enable_set = this->pin_settings.c0_all;
-        delay(1);
+        hal_gpio_output_enable_set(this->pin_settings.c0_all);
+        this->settle_wait(hal_time_us() + 1000);
 
         // C0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.c0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.c0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
 
         // R0 HIGH
-        *gpio_output_enable_clear = this->pin_settings.r0_all;
-        delayMicroseconds(SCAN_DELAY);
+        hal_gpio_output_enable_clear(this->pin_settings.r0_all);
+        this->settle_wait(hal_time_us() + SCAN_DELAY);
     }
 
     /**
@@ -369,6 +350,7 @@ namespace AZO_KEYBOARD_INTERFACE
     * @retval None
     */
     void KeyboardInterface::iqs9320_i2c_read_fp(){
+        this->i2c_device = 0xFF;
         this->i2c_control.input_index = 0;
 
         // Default read condition
@@ -377,18 +359,18 @@ namespace AZO_KEYBOARD_INTERFACE
             Wire.beginTransmission(this->i2c_control.device_addr);
             Wire.write(this->i2c_control.register_addr_lsb);
             Wire.write(this->i2c_control.register_addr_msb);
-            Wire.endTransmission(false);
+            this->i2c_end(false);
         }
 
         // Read at specific address
-        Wire.requestFrom(this->i2c_control.device_addr, this->i2c_control.data_len);
+        this->i2c_request(this->i2c_control.device_addr, this->i2c_control.data_len);
         while(Wire.available())
         {
             this->i2c_control.input_data[this->i2c_control.input_index] = Wire.read();
             this->i2c_control.input_index++;
         }
 
-        Serial.write(this->i2c_control.input_data, this->i2c_control.data_len);
+        this->output_write(this->i2c_control.input_data, this->i2c_control.data_len);
         memset(this->i2c_control.input_data, 0, this->i2c_control.data_len);
     }
 
@@ -402,11 +384,12 @@ namespace AZO_KEYBOARD_INTERFACE
     * @retval None
     */
     void KeyboardInterface::iqs9320_i2c_write_fp(){
+        this->i2c_device = 0xFF;
         Wire.beginTransmission(this->i2c_control.device_addr);
         Wire.write(this->i2c_control.register_addr_lsb);
         Wire.write(this->i2c_control.register_addr_msb);
         Wire.write(this->i2c_control.output_data, this->i2c_control.data_len);
-        Wire.endTransmission();
+        this->i2c_end(true);
     }
 
     /**
@@ -416,35 +399,91 @@ namespace AZO_KEYBOARD_INTERFACE
     *         configured for the key scanning communications interface and do not
     *         support full-polling I2C.
     *         Parameters are defined in the do_command() function in the azo_ki_main.cpp file.
+    *         Static registers are served from the register cache.
+    *         Zeros are returned if the device does not acknowledge the configuration handshake.
     * @param  None
-    * @retval None
+    * @retval Returns false if the device did not exit the configuration state.
     */
-    void KeyboardInterface::iqs9320_i2c_read_ks(){
-        // Enable I2C on IQS device
-        this->iqs9320_config_enter(get_device_column(this->i2c_control.device_select), get_device_row(this->i2c_control.device_select));
+    bool KeyboardInterface::iqs9320_i2c_read_ks(){
+        uint16_t register_addr = this->i2c_control.register_addr_lsb | (this->i2c_control.register_addr_msb << 8);
+        bool released = true;
 
-        this->i2c_control.input_index = 0;
+        // Static registers are served from the register cache
+        if (!this->cache_read_hit(this->i2c_control.device_select, register_addr,
+                                  this->i2c_control.input_data, this->i2c_control.data_len))
+        {
+            this->i2c_control.input_index = 0;
 
-        // I2C Comms
-        Wire.beginTransmission(this->i2c_control.device_addr);
-        Wire.write(this->i2c_control.register_addr_lsb);
-        Wire.write(this->i2c_control.register_addr_msb);
-        Wire.endTransmission(false);
+            // Enable I2C on IQS device, the read is skipped if it does not acknowledge
+            if (this->iqs9320_config_enter(get_device_column(this->i2c_control.device_select), get_device_row(this->i2c_control.device_select)))
+            {
+                // I2C Comms
+                Wire.beginTransmission(this->i2c_control.device_addr);
+                Wire.write(this->i2c_control.register_addr_lsb);
+                Wire.write(this->i2c_control.register_addr_msb);
+                this->i2c_end(false);
+
+                // Receive I2C data
+                this->i2c_request(this->i2c_control.device_addr, this->i2c_control.data_len);
+                while (Wire.available())
+                {
+                    this->i2c_control.input_data[this->i2c_control.input_index] = Wire.read();
+                    this->i2c_control.input_index++;
+                    if (this->i2c_control.input_index >= this->i2c_control.data_len) break;
+                }
+            }
 
-        // Receive I2C data
-        Wire.requestFrom(this->i2c_control.device_addr, this->i2c_control.data_len);
-        while (Wire.available())
-        {
-            this->i2c_control.input_data[this->i2c_control.input_index] = Wire.read();
-            this->i2c_control.input_index++;
-            if (this->i2c_control.input_index >= this->i2c_control.data_len) break;
-        }
+            // Disable I2C on IQS device
+            released = this->iqs9320_config_exit(get_device_row(this->i2c_control.device_select));
 
-        // Disable I2C on IQS device
-        this->iqs9320_config_exit(get_device_row(this->i2c_control.device_select));
+            if (this->i2c_control.input_index == this->i2c_control.data_len)
+            {
+                this->cache_store_read(this->i2c_control.device_select, register_addr,
+                                       this->i2c_control.input_data, this->i2c_control.data_len);
+            }
+        }
 
-        Serial.write(this->i2c_control.input_data, this->i2c_control.data_len);
+        this->output_write(this->i2c_control.input_data, this->i2c_control.data_len);
         memset(this->i2c_control.input_data, 0, this->i2c_control.data_len);
+        return released;
+    }
+
+    /**
+    * @name   iqs9320_i2c_read_ks_batch
+    * @brief  Read the registers of a stream from the selected device, or from every device
+    *         in the device matrix when device_select is 0xFF. Each device is placed in the
+    *         configuration state once and all registers are read back to back.
+    *         The data is returned per device, in register order.
+    *         This function is applicable to IQS9320 devices which are
+    *         configured for the key scanning communications interface.
+    * @param  stream -> Stream with the registers to read
+    * @retval None
+    */
+    void KeyboardInterface::iqs9320_i2c_read_ks_batch(const stream_control_t *stream){
+        uint8_t device_select = this->i2c_control.device_select;
+        bool released = true;   // Cleared when a device does not exit the configuration state
+
+        for (uint8_t i = 0; i < this->num_columns*this->num_rows; i++)
+        {
+            if ((device_select != 0xFF) && (i != device_select)) continue;
+
+            // Zeros are returned for a device that does not acknowledge, and for all
+            // devices after one that did not exit the configuration state
+            if (!released)
+            {
+                this->stream_skip_registers(stream);
+                continue;
+            }
+
+            // Enable I2C on IQS device
+            if (this->iqs9320_config_enter(get_device_column(i), get_device_row(i)))
+                this->stream_read_registers(stream, 2);
+            else
+                this->stream_skip_registers(stream);
+
+            // Disable I2C on IQS device
+            released = this->iqs9320_config_exit(get_device_row(i));
+        }
     }
 
     /**
@@ -454,22 +493,35 @@ namespace AZO_KEYBOARD_INTERFACE
     *         configured for the key scanning communications interface and do not
     *         support full-polling I2C.
     *         Parameters are defined in the do_command() function in the azo_ki_main.cpp file.
+    *         A write within a skip range is skipped when the register cache shows the device holds the data.
+    *         The write is also skipped if the device does not acknowledge the configuration handshake.
     * @param  None
-    * @retval None
+    * @retval Returns false if the device did not exit the configuration state.
     */
-    void KeyboardInterface::iqs9320_i2c_write_ks(){
-        // Enable I2C on IQS device
-        this->iqs9320_config_enter(get_device_column(this->i2c_control.device_select), get_device_row(this->i2c_control.device_select));
+    bool KeyboardInterface::iqs9320_i2c_write_ks(){
+        uint16_t register_addr = this->i2c_control.register_addr_lsb | (this->i2c_control.register_addr_msb << 8);
 
-        // I2C Comms
-        Wire.beginTransmission(this->i2c_control.device_addr);
-        Wire.write(this->i2c_control.register_addr_lsb);
-        Wire.write(this->i2c_control.register_addr_msb);
-        Wire.write(this->i2c_control.output_data, this->i2c_control.data_len);
-        Wire.endTransmission(true);
+        // Skip the write when the device already holds the data
+        if (this->cache_write_hit(this->i2c_control.device_select, register_addr,
+                                  this->i2c_control.output_data, this->i2c_control.data_len)) return true;
+
+        // Enable I2C on IQS device
+        if (this->iqs9320_config_enter(get_device_column(this->i2c_control.device_select), get_device_row(this->i2c_control.device_select)))
+        {
+            // I2C Comms
+            Wire.beginTransmission(this->i2c_control.device_addr);
+            Wire.write(this->i2c_control.register_addr_lsb);
+            Wire.write(this->i2c_control.register_addr_msb);
+            Wire.write(this->i2c_control.output_data, this->i2c_control.data_len);
+            if (this->i2c_end(true))
+            {
+                this->cache_store_write(this->i2c_control.device_select, register_addr,
+                                        this->i2c_control.output_data, this->i2c_control.data_len);
+            }
+        }
 
         // Disable I2C on IQS device
-        this->iqs9320_config_exit(get_device_row(this->i2c_control.device_select));
+        return this->iqs9320_config_exit(get_device_row(this->i2c_control.device_select));
     }
 
 }
\ No newline at end of file